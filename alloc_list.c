@@ -0,0 +1,175 @@
+// record the blocks a compilation allocates (see alloc_list.h)
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "alloc_list.h"
+#include "utilities.h"
+
+// The current allocation list (or NULL for none)
+static alloc_list *current = NULL;
+
+// Guards the current list, as statements may be parsed in parallel
+static pthread_mutex_t current_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Marks a slot whose block was removed
+static char removed_mark;
+#define REMOVED ((void *) &removed_mark)
+
+// Make list an empty allocation list
+void alloc_list_init(alloc_list *list)
+{
+    list->slots = NULL;
+    list->capacity = 0;
+    list->count = 0;
+    list->used = 0;
+}
+
+// Make list the current allocation list
+void set_alloc_list(alloc_list *list)
+{
+    current = list;
+}
+
+// Return the slot to start looking for ptr in, in a table with capacity slots
+static size_t slot_of(const void *ptr, size_t capacity)
+{
+    uint64_t h = (uint64_t) (uintptr_t) ptr;
+    h ^= h >> 29;
+    h *= UINT64_C(0x9E3779B97F4A7C15);
+    h ^= h >> 32;
+    return (size_t) h & (capacity - 1);
+}
+
+// Requires: ptr is not in list, and list has a free slot
+// Put ptr into list's slots
+static void put_block(alloc_list *list, void *ptr)
+{
+    size_t i = slot_of(ptr, list->capacity);
+    while (list->slots[i] != NULL && list->slots[i] != REMOVED) {
+	i = (i + 1) & (list->capacity - 1);
+    }
+    if (list->slots[i] == NULL) {
+	list->used++;
+    }
+    list->slots[i] = ptr;
+    list->count++;
+}
+
+// Requires: ptr != NULL
+// Record the block ptr in list, growing its slots when they are
+// three quarters used, and return whether there was space to
+static bool add_block(alloc_list *list, void *ptr)
+{
+    if (4 * (list->used + 1) > 3 * list->capacity) {
+	size_t new_capacity = (list->capacity == 0) ? 256
+	    : (2 * list->count + 2 > list->capacity) ? 2 * list->capacity
+	    : list->capacity;
+	void **old = list->slots;
+	size_t old_capacity = list->capacity;
+	list->slots = calloc(new_capacity, sizeof(void *));
+	if (list->slots == NULL) {
+	    list->slots = old;
+	    return false;
+	}
+	list->capacity = new_capacity;
+	list->count = 0;
+	list->used = 0;
+	for (size_t i = 0; i < old_capacity; i++) {
+	    if (old[i] != NULL && old[i] != REMOVED) {
+		put_block(list, old[i]);
+	    }
+	}
+	free(old);
+    }
+    put_block(list, ptr);
+    return true;
+}
+
+// Remove the block ptr from list, if it is there
+static void remove_block(alloc_list *list, void *ptr)
+{
+    if (list->capacity == 0) {
+	return;
+    }
+    size_t i = slot_of(ptr, list->capacity);
+    while (list->slots[i] != NULL) {
+	if (list->slots[i] == ptr) {
+	    list->slots[i] = REMOVED;
+	    list->count--;
+	    return;
+	}
+	i = (i + 1) & (list->capacity - 1);
+    }
+}
+
+// Return a block of size bytes, recording it in the current list
+void *alloc_list_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (current != NULL && ptr != NULL) {
+	pthread_mutex_lock(&current_lock);
+	bool added = add_block(current, ptr);
+	pthread_mutex_unlock(&current_lock);
+	if (!added) {
+	    free(ptr);
+	    bail_with_error("No space to record an allocation!");
+	}
+    }
+    return ptr;
+}
+
+// Resize the block ptr to size bytes, recording the result in the current list
+void *alloc_list_realloc(void *ptr, size_t size)
+{
+    if (current == NULL) {
+	return realloc(ptr, size);
+    }
+    pthread_mutex_lock(&current_lock);
+    if (ptr != NULL) {
+	remove_block(current, ptr);
+    }
+    void *ret = realloc(ptr, size);
+    // if there is no space, ptr is still allocated, so record it again
+    void *block = (ret != NULL) ? ret : ptr;
+    bool added = block == NULL || add_block(current, block);
+    pthread_mutex_unlock(&current_lock);
+    if (!added) {
+	free(block);
+	bail_with_error("No space to record an allocation!");
+    }
+    return ret;
+}
+
+// Free the block ptr, removing it from the current list
+void alloc_list_free(void *ptr)
+{
+    if (current != NULL && ptr != NULL) {
+	pthread_mutex_lock(&current_lock);
+	remove_block(current, ptr);
+	pthread_mutex_unlock(&current_lock);
+    }
+    free(ptr);
+}
+
+// Remove the block ptr from the current list, as something else owns it now
+void alloc_list_keep(void *ptr)
+{
+    if (current != NULL && ptr != NULL) {
+	pthread_mutex_lock(&current_lock);
+	remove_block(current, ptr);
+	pthread_mutex_unlock(&current_lock);
+    }
+}
+
+// Free all the blocks recorded in list, and make it empty
+void alloc_list_release(alloc_list *list)
+{
+    for (size_t i = 0; i < list->capacity; i++) {
+	if (list->slots[i] != NULL && list->slots[i] != REMOVED) {
+	    free(list->slots[i]);
+	}
+    }
+    free(list->slots);
+    alloc_list_init(list);
+}
@@ -0,0 +1,50 @@
+#ifndef _ALLOC_LIST_H
+#define _ALLOC_LIST_H
+#include <stddef.h>
+
+// An allocation list records the blocks that a compilation allocates
+// for ASTs and token texts (and for the stacks of AST walks),
+// so that when a compilation is abandoned (because an error was caught
+// with an error catcher, see utilities.h), everything it allocated
+// can be freed, and when it finishes, what it allocated but did not
+// keep (e.g., the texts of tokens that no AST uses) can be freed.
+// A list only records blocks while it is the current list
+// (see set_alloc_list); otherwise the functions below just
+// allocate and free blocks as malloc, realloc, and free do.
+
+// The blocks recorded, kept in an open-addressing hash set
+typedef struct {
+    void **slots;     // capacity slots, each NULL, a block, or removed
+    size_t capacity;  // a power of 2, or 0
+    size_t count;     // the number of blocks in slots
+    size_t used;      // the number of slots that are not NULL
+} alloc_list;
+
+// Make list an empty allocation list
+extern void alloc_list_init(alloc_list *list);
+
+// Make list (which may be NULL, for none) the current allocation list,
+// which records the blocks allocated by the functions below
+extern void set_alloc_list(alloc_list *list);
+
+// Return a block of size bytes, as malloc does,
+// recording it in the current allocation list
+extern void *alloc_list_malloc(size_t size);
+
+// Resize the block ptr to size bytes, as realloc does,
+// recording the block returned in the current allocation list
+extern void *alloc_list_realloc(void *ptr, size_t size);
+
+// Free the block ptr (if not NULL), removing it from
+// the current allocation list, if it is there
+extern void alloc_list_free(void *ptr);
+
+// Remove the block ptr (if not NULL) from the current allocation list
+// (if it is there), as something that lasts longer now owns it
+extern void alloc_list_keep(void *ptr);
+
+// Requires: list is not the current allocation list
+// Free all the blocks recorded in list, and make it empty
+extern void alloc_list_release(alloc_list *list);
+
+#endif
@@ -1,37 +1,41 @@
 /* $Id: ast.c,v 1.9 2023/02/21 03:17:40 leavens Exp $ */
 #include <stdlib.h>
 #include "utilities.h"
+#include "alloc_list.h"
 #include "ast.h"
+#include "ast_visitor.h"
 
 // Return a (pointer to a) fresh AST
 // and fill in its file_location with the given file name (fn),
 // line number (ln) and column number (col).
-// Also initializes the next pointer to NULL.
 // If there is no space to allocate an AST node,
 // print an error on stderr and exit with a failure code.
 static AST *ast_allocate(const char *fn, unsigned int ln, unsigned int col)
 {
-    AST *ret = (AST *) malloc(sizeof(AST));
+    AST *ret = (AST *) alloc_list_malloc(sizeof(AST));
     if (ret == NULL) {
 	bail_with_error("No space to create const_def AST!");
     }
     ret->file_loc.filename = fn;
     ret->file_loc.line = ln;
     ret->file_loc.column = col;
-    ret->next = NULL;
     return ret;
 }
 
 // Return a (pointer to a) fresh AST for a program, whose first token
 // starts in the given file (fn), line (ln), and column (col),
-// and which contains the given ASTs for const-decls (cds), var-decls (vds)
+// and which contains the given arrays of ASTs for const-decls
+// (num_cds elements in cds), var-decls (num_vds elements in vds),
 // and statement (stmt).
 AST *ast_program(const char *fn, unsigned int ln, unsigned int col,
-		 AST *cds, AST *vds, AST *stmt)
+		 unsigned int num_cds, AST **cds,
+		 unsigned int num_vds, AST **vds, AST *stmt)
 {
     AST *ret = ast_allocate(fn, ln, col);
     ret->type_tag = program_ast;
+    ret->data.program.num_cds = num_cds;
     ret->data.program.cds = cds;
+    ret->data.program.num_vds = num_vds;
     ret->data.program.vds = vds;
     ret->data.program.stmt = stmt;
     return ret;
@@ -69,12 +73,14 @@ AST *ast_assign_stmt(token t, const char *ident, AST *exp)
     return ret;
 }
 
+// Requires: num_stmts > 0
 // Return a (pointer to a) fresh AST for a begin-statement
-// with statments AST stmts.
-AST *ast_begin_stmt(token t, AST *stmts)
+// with the array of num_stmts statement ASTs stmts.
+AST *ast_begin_stmt(token t, unsigned int num_stmts, AST **stmts)
 {
     AST *ret = ast_allocate(t.filename, t.line, t.column);
     ret->type_tag = begin_ast;
+    ret->data.begin_stmt.num_stmts = num_stmts;
     ret->data.begin_stmt.stmts = stmts;
     return ret;
 }
@@ -196,56 +202,131 @@ AST *ast_number(token t, short int value)
     return ret;
 }
 
-// Return an AST list that is empty
-AST_list ast_list_empty_list()
+// Initialize b to build an empty array
+void ast_array_builder_init(AST_array_builder *b)
 {
-    return NULL;
+    b->elems = NULL;
+    b->count = 0;
+    b->capacity = 0;
 }
 
-// Return an AST list consisting of just the given AST node (ast)
-AST_list ast_list_singleton(AST *ast)
+// Add ast to the end of the array being built by b
+void ast_array_builder_add(AST_array_builder *b, AST *ast)
 {
-    return ast;
+    if (b->count == b->capacity) {
+	b->capacity = (b->capacity == 0) ? 4 : 2 * b->capacity;
+	b->elems = (AST **) alloc_list_realloc(b->elems, b->capacity * sizeof(AST *));
+	if (b->elems == NULL) {
+	    bail_with_error("No space to grow an array of ASTs!");
+	}
+    }
+    b->elems[b->count++] = ast;
 }
 
-// Return true just when lst is an empty list (and false otherwise)
-bool ast_list_is_empty(AST_list lst)
+// Return the array built by b, trimmed to its b->count elements
+// (NULL if it is empty), and make b empty again.
+// The caller should save b->count before calling this.
+AST **ast_array_builder_finish(AST_array_builder *b)
 {
-    return lst == NULL;
+    AST **ret = b->elems;
+    if (b->count == 0) {
+	alloc_list_free(ret);
+	ret = NULL;
+    } else if (b->count < b->capacity) {
+	ret = (AST **) alloc_list_realloc(ret, b->count * sizeof(AST *));
+	if (ret == NULL) {
+	    bail_with_error("No space to trim an array of ASTs!");
+	}
+    }
+    ast_array_builder_init(b);
+    return ret;
 }
 
-// Requires lst != NULL
-// Return the first element in an AST_list
-AST *ast_list_first(AST_list lst)
+// Free ast itself, and the array and name it owns
+// (its children have already been freed)
+static void ast_free_node(AST *ast, void *data)
 {
-    // each node is an AST itself, so the first element is lst
-    return lst;
+    switch (ast->type_tag) {
+    case program_ast:
+	alloc_list_free(ast->data.program.cds);
+	alloc_list_free(ast->data.program.vds);
+	break;
+    case const_decl_ast:
+	alloc_list_free((char *) ast->data.const_decl.name);
+	break;
+    case var_decl_ast:
+	alloc_list_free((char *) ast->data.var_decl.name);
+	break;
+    case assign_ast:
+	alloc_list_free((char *) ast->data.assign_stmt.name);
+	break;
+    case begin_ast:
+	alloc_list_free(ast->data.begin_stmt.stmts);
+	break;
+    case read_ast:
+	alloc_list_free((char *) ast->data.read_stmt.name);
+	break;
+    case ident_ast:
+	alloc_list_free((char *) ast->data.ident.name);
+	break;
+    default:
+	break;
+    }
+    alloc_list_free(ast);
 }
 
-// Requires lst != NULL
-// Return the rest of the AST_list (which is null if it is empty)
-AST_list ast_list_rest(AST_list lst)
+// Free ast (if it is not NULL) and all the ASTs, arrays,
+// and names in it
+void ast_free(AST *ast)
 {
-    return lst->next;
+    if (ast == NULL) {
+	return;
+    }
+    ast_visitor v = { NULL, ast_free_node, NULL };
+    ast_walk(ast, &v, 1);
 }
 
-
-// Return the last element in the AST list lst.
-// The result is only NULL if ast_list_is_empty(lst);
-AST_list ast_list_last_elem(AST_list lst)
+// Keep ast itself, and the array and name it owns, out of
+// the current allocation list (the same blocks ast_free_node frees)
+static bool ast_keep_node(AST *ast, void *data)
 {
-    AST *prev = NULL;
-    while (!ast_list_is_empty(lst)) {
-	prev = lst;
-	lst = ast_list_rest(lst);
+    switch (ast->type_tag) {
+    case program_ast:
+	alloc_list_keep(ast->data.program.cds);
+	alloc_list_keep(ast->data.program.vds);
+	break;
+    case const_decl_ast:
+	alloc_list_keep((char *) ast->data.const_decl.name);
+	break;
+    case var_decl_ast:
+	alloc_list_keep((char *) ast->data.var_decl.name);
+	break;
+    case assign_ast:
+	alloc_list_keep((char *) ast->data.assign_stmt.name);
+	break;
+    case begin_ast:
+	alloc_list_keep(ast->data.begin_stmt.stmts);
+	break;
+    case read_ast:
+	alloc_list_keep((char *) ast->data.read_stmt.name);
+	break;
+    case ident_ast:
+	alloc_list_keep((char *) ast->data.ident.name);
+	break;
+    default:
+	break;
     }
-    // here ast_list_is_empty(lst)
-    return prev;
+    alloc_list_keep(ast);
+    return true;
 }
 
-// Requires: !ast_list_is_empty(lst) and ast_list_is_empty(ast_list_rest(lst))
-// Make newtail the tail of the AST_list starting at lst
-void ast_list_splice(AST_list lst, AST_list newtail)
+// Remove ast (if it is not NULL) and all the ASTs, arrays,
+// and names in it from the current allocation list
+void ast_keep(AST *ast)
 {
-    lst->next = newtail;
+    if (ast == NULL) {
+	return;
+    }
+    ast_visitor v = { ast_keep_node, NULL, NULL };
+    ast_walk(ast, &v, 1);
 }
@@ -15,8 +15,9 @@ typedef enum {
 
 // forward declaration, so can use the type AST* below
 typedef struct AST_s AST;
-// lists of ASTs
-typedef AST *AST_list;
+
+// Lists of ASTs (declarations and the statements of a begin)
+// are stored as counted arrays of pointers to ASTs.
 
 // The following types for structs named N_t
 // are used in the declaration of the AST_s struct below.
@@ -31,8 +32,10 @@ typedef AST *AST_list;
 
 // P ::= { CD } { VD } S
 typedef struct {
-    AST_list cds;
-    AST_list vds;
+    unsigned int num_cds;
+    unsigned int num_vds;
+    AST **cds; // num_cds const-decls
+    AST **vds; // num_vds var-decls
     AST *stmt;
 } program_t;
 
@@ -55,7 +58,8 @@ typedef struct {
 
 // S ::= begin { S }
 typedef struct {
-    AST_list stmts;
+    unsigned int num_stmts;
+    AST **stmts; // num_stmts statements (num_stmts > 0)
 } begin_t;
 
 // S ::= if C S1 S2
@@ -132,7 +136,6 @@ typedef struct {
 // The actual AST definition:
 typedef struct AST_s {
     file_location file_loc;
-    AST_list next;  // for lists
     AST_type type_tag;
     union AST_u {
 	program_t program;
@@ -156,10 +159,12 @@ typedef struct AST_s {
 
 // Return a (pointer to a) fresh AST for a program, whose first token
 // starts in the given file (fn), line (ln), and column (col),
-// and which contains the given ASTs for const-decls (cds), var-decls (vds)
+// and which contains the given arrays of ASTs for const-decls
+// (num_cds elements in cds), var-decls (num_vds elements in vds),
 // and statement (stmt).
-extern AST *ast_program(const char *fn, unsigned int ln, unsigned int col, 
-						AST_list cds, AST_list vds, AST *stmt);
+extern AST *ast_program(const char *fn, unsigned int ln, unsigned int col,
+			unsigned int num_cds, AST **cds,
+			unsigned int num_vds, AST **vds, AST *stmt);
 
 // Return a (pointer to a) fresh AST for a const definition
 // with name ident and value num, which starts at the token t
@@ -173,9 +178,10 @@ extern AST *ast_var_decl(token t, const char *ident);
 // with name ident and expression AST exp.
 extern AST *ast_assign_stmt(token t, const char *ident, AST *exp);
 
+// Requires: num_stmts > 0
 // Return a (pointer to a) fresh AST for a begin-statement
-// with statments AST stmts.
-extern AST *ast_begin_stmt(token t, AST_list stmts);
+// with the array of num_stmts statement ASTs stmts.
+extern AST *ast_begin_stmt(token t, unsigned int num_stmts, AST **stmts);
 
 // Return a (pointer to a) fresh AST for an if-statement
 // with condition AST cond, then part thenstmt, and else part elsestmt
@@ -222,29 +228,32 @@ extern AST *ast_ident(token t, const char *name);
 // with the given value
 extern AST *ast_number(token t, short int value);
 
-// Return an AST list that is empty
-extern AST_list ast_list_empty_list();
-
-// Return an AST list consisting of just the given AST node (ast)
-extern AST_list ast_list_singleton(AST *ast);
+// Free ast (if it is not NULL) and all the ASTs, arrays,
+// and names in it
+extern void ast_free(AST *ast);
 
-// Return true just when lst is an empty list (and false otherwise)
-extern bool ast_list_is_empty(AST_list lst);
+// Remove ast (if it is not NULL) and all the ASTs, arrays, and names in it
+// from the current allocation list (see alloc_list.h), so that releasing
+// the list does not free them (they are then freed by ast_free)
+extern void ast_keep(AST *ast);
 
-// Requires: !ast_list_is_empty(lst)
-// Return the first element in an AST_list
-extern AST *ast_list_first(AST_list lst);
+// An array of ASTs that is being built, which grows as needed,
+// so adding an element to its end takes amortized constant time
+typedef struct {
+    AST **elems;
+    unsigned int count;  // number of elements in elems
+    unsigned int capacity;  // number of elements elems has room for
+} AST_array_builder;
 
-// Requires: !ast_list_is_empty(lst)
-// Return the rest of the AST_list (which is null if it is empty)
-extern AST_list ast_list_rest(AST_list lst);
+// Initialize b to build an empty array
+extern void ast_array_builder_init(AST_array_builder *b);
 
-// Requires: !ast_list_is_empty(lst) and ast_list_is_empty(ast_list_rest(lst))
-// Make newtail the tail of the AST_list starting at lst
-extern void ast_list_splice(AST_list lst, AST_list newtail);
+// Add ast to the end of the array being built by b
+extern void ast_array_builder_add(AST_array_builder *b, AST *ast);
 
-// Return the last element in the AST list lst.
-// The result is only NULL if ast_list_is_empty(lst);
-extern AST_list ast_list_last_elem(AST_list lst);
+// Return the array built by b, trimmed to its b->count elements
+// (NULL if it is empty), and make b empty again.
+// The caller should save b->count before calling this.
+extern AST **ast_array_builder_finish(AST_array_builder *b);
 
 #endif
@@ -0,0 +1,538 @@
+// write ASTs as images and map them back into memory (see ast_image.h)
+// for mmap
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ast_image.h"
+#include "utilities.h"
+
+// The offset in an image of its first node
+#define NODES_OFFSET sizeof(ast_image_header)
+
+_Static_assert(sizeof(ast_image_header) % _Alignof(AST) == 0,
+	       "the nodes of an image must be aligned");
+
+// The kinds of AST that a field may hold
+typedef enum {
+    stmt_kind, cond_kind, expr_kind, const_decl_kind, var_decl_kind
+} ast_kind;
+
+// The fields of an AST that hold pointers, other than its file name
+typedef struct {
+    const char **name;        // its name, or NULL if it has none
+    AST **children[3];        // its fields holding a child
+    ast_kind child_kinds[3];  // the kind of AST each one holds
+    unsigned int num_children;
+    AST ***arrays[2];         // its fields holding an array of children
+    unsigned int array_lengths[2];
+    ast_kind array_kinds[2];  // the kind of AST in each one
+    unsigned int num_arrays;
+} ast_fields;
+
+// Add the field child, which holds an AST of the given kind, to *f
+static void add_child(ast_fields *f, AST **child, ast_kind kind)
+{
+    f->children[f->num_children] = child;
+    f->child_kinds[f->num_children] = kind;
+    f->num_children++;
+}
+
+// Add the field array, which holds len ASTs of the given kind, to *f
+static void add_array(ast_fields *f, AST ***array, unsigned int len,
+		      ast_kind kind)
+{
+    f->arrays[f->num_arrays] = array;
+    f->array_lengths[f->num_arrays] = len;
+    f->array_kinds[f->num_arrays] = kind;
+    f->num_arrays++;
+}
+
+// Is an AST with the tag t of the given kind?
+static bool is_kind(AST_type t, ast_kind kind)
+{
+    switch (kind) {
+    case stmt_kind:
+	return t == assign_ast || t == begin_ast || t == if_ast
+	    || t == while_ast || t == read_ast || t == write_ast
+	    || t == skip_ast;
+    case cond_kind:
+	return t == odd_cond_ast || t == bin_cond_ast;
+    case expr_kind:
+	return t == op_expr_ast || t == bin_expr_ast || t == ident_ast
+	    || t == number_ast;
+    case const_decl_kind:
+	return t == const_decl_ast;
+    case var_decl_kind:
+	return t == var_decl_ast;
+    }
+    return false;
+}
+
+// Set *f to the fields of ast that hold pointers
+static void ast_get_fields(AST *ast, ast_fields *f)
+{
+    f->name = NULL;
+    f->num_children = 0;
+    f->num_arrays = 0;
+    switch (ast->type_tag) {
+    case program_ast:
+	add_array(f, &ast->data.program.cds, ast->data.program.num_cds,
+		  const_decl_kind);
+	add_array(f, &ast->data.program.vds, ast->data.program.num_vds,
+		  var_decl_kind);
+	add_child(f, &ast->data.program.stmt, stmt_kind);
+	break;
+    case const_decl_ast:
+	f->name = &ast->data.const_decl.name;
+	break;
+    case var_decl_ast:
+	f->name = &ast->data.var_decl.name;
+	break;
+    case assign_ast:
+	f->name = &ast->data.assign_stmt.name;
+	add_child(f, &ast->data.assign_stmt.exp, expr_kind);
+	break;
+    case begin_ast:
+	add_array(f, &ast->data.begin_stmt.stmts, ast->data.begin_stmt.num_stmts,
+		  stmt_kind);
+	break;
+    case if_ast:
+	add_child(f, &ast->data.if_stmt.cond, cond_kind);
+	add_child(f, &ast->data.if_stmt.thenstmt, stmt_kind);
+	add_child(f, &ast->data.if_stmt.elsestmt, stmt_kind);
+	break;
+    case while_ast:
+	add_child(f, &ast->data.while_stmt.cond, cond_kind);
+	add_child(f, &ast->data.while_stmt.stmt, stmt_kind);
+	break;
+    case read_ast:
+	f->name = &ast->data.read_stmt.name;
+	break;
+    case write_ast:
+	add_child(f, &ast->data.write_stmt.exp, expr_kind);
+	break;
+    case odd_cond_ast:
+	add_child(f, &ast->data.odd_cond.exp, expr_kind);
+	break;
+    case bin_cond_ast:
+	add_child(f, &ast->data.bin_cond.leftexp, expr_kind);
+	add_child(f, &ast->data.bin_cond.rightexp, expr_kind);
+	break;
+    case op_expr_ast:
+	add_child(f, &ast->data.op_expr.exp, expr_kind);
+	break;
+    case bin_expr_ast:
+	add_child(f, &ast->data.bin_expr.leftexp, expr_kind);
+	add_child(f, &ast->data.bin_expr.rightexp, expr_kind);
+	break;
+    case ident_ast:
+	f->name = &ast->data.ident.name;
+	break;
+    default:
+	break;
+    }
+}
+
+// Return the offset off as the value of a pointer field in an image
+static void *as_pointer(uint64_t off)
+{
+    return (void *) (uintptr_t) off;
+}
+
+// Return the offset held in a pointer field p of an image
+static uint64_t as_offset(const void *p)
+{
+    return (uint64_t) (uintptr_t) p;
+}
+
+// An image being written
+typedef struct {
+    AST *nodes;                // copies of the nodes
+    size_t num_nodes, nodes_capacity;
+    uint64_t *slots;           // the arrays of children
+    size_t num_slots, slots_capacity;
+    char *strings;             // the names and file names
+    size_t strings_size, strings_capacity;
+    // a hash table of the offsets in strings of the names (plus 1, or 0
+    // for an empty entry), so that each is only written once
+    size_t *interned;
+    size_t interned_capacity, num_interned;
+} image_builder;
+
+// Grow the array *elems, which has room for *capacity elements of size
+// elem_size, so it has room for at least needed of them
+static void grow(void **elems, size_t *capacity, size_t needed,
+		 size_t elem_size)
+{
+    if (needed <= *capacity) {
+	return;
+    }
+    size_t new_capacity = (*capacity == 0) ? 64 : *capacity;
+    while (new_capacity < needed) {
+	new_capacity *= 2;
+    }
+    void *grown = realloc(*elems, new_capacity * elem_size);
+    if (grown == NULL) {
+	bail_with_error("No space to write an AST image!");
+    }
+    *elems = grown;
+    *capacity = new_capacity;
+}
+
+// Return a hash of the string s
+static size_t hash_string(const char *s)
+{
+    size_t h = 14695981039346656037u;
+    for (; *s != '\0'; s++) {
+	h = (h ^ (unsigned char) *s) * 1099511628211u;
+    }
+    return h;
+}
+
+// Put the string s (if it is not there already) in b's strings
+// and return its offset in them
+static size_t intern(image_builder *b, const char *s)
+{
+    if (2 * (b->num_interned + 1) > b->interned_capacity) {
+	// rehash into a table twice as big
+	size_t old_capacity = b->interned_capacity;
+	size_t *old = b->interned;
+	b->interned_capacity = (old_capacity == 0) ? 64 : 2 * old_capacity;
+	b->interned = calloc(b->interned_capacity, sizeof(size_t));
+	if (b->interned == NULL) {
+	    bail_with_error("No space to write an AST image!");
+	}
+	for (size_t i = 0; i < old_capacity; i++) {
+	    if (old[i] != 0) {
+		size_t j = hash_string(b->strings + old[i] - 1);
+		while (b->interned[j & (b->interned_capacity - 1)] != 0) {
+		    j++;
+		}
+		b->interned[j & (b->interned_capacity - 1)] = old[i];
+	    }
+	}
+	free(old);
+    }
+    size_t j = hash_string(s);
+    size_t *entry;
+    while (*(entry = &b->interned[j & (b->interned_capacity - 1)]) != 0) {
+	if (strcmp(b->strings + *entry - 1, s) == 0) {
+	    return *entry - 1;
+	}
+	j++;
+    }
+    size_t len = strlen(s) + 1;
+    grow((void **) &b->strings, &b->strings_capacity, b->strings_size + len, 1);
+    memcpy(b->strings + b->strings_size, s, len);
+    *entry = b->strings_size + 1;
+    b->num_interned++;
+    b->strings_size += len;
+    return *entry - 1;
+}
+
+// An AST that is still to be copied into an image,
+// and the field or slot that is to hold its offset
+typedef struct {
+    const AST *ast;
+    size_t parent;       // the index of the node with the field
+    int child;           // which of its children it is (or -1 for a slot)
+    size_t slot;         // the index of the slot (if child is -1)
+} pending_node;
+
+// Copy the nodes of ast into b, each one after the node that refers to it,
+// leaving their arrays and names as indexes into b's slots and strings
+// (plus 1, for those that are not NULL)
+static void copy_nodes(image_builder *b, const AST *ast)
+{
+    pending_node *stack = NULL;
+    size_t size = 0, capacity = 0;
+    grow((void **) &stack, &capacity, 1, sizeof(pending_node));
+    stack[size++] = (pending_node) { ast, 0, -1, 0 };
+    bool root = true;
+    while (size > 0) {
+	pending_node p = stack[--size];
+	size_t index = b->num_nodes;
+	grow((void **) &b->nodes, &b->nodes_capacity, index + 1, sizeof(AST));
+	b->num_nodes++;
+	AST *copy = &b->nodes[index];
+	*copy = *p.ast;
+	uint64_t off = NODES_OFFSET + index * sizeof(AST);
+	if (root) {
+	    root = false;
+	} else if (p.child < 0) {
+	    b->slots[p.slot] = off;
+	} else {
+	    ast_fields pf;
+	    ast_get_fields(&b->nodes[p.parent], &pf);
+	    *pf.children[p.child] = as_pointer(off);
+	}
+
+	copy->file_loc.filename
+	    = as_pointer(intern(b, copy->file_loc.filename) + 1);
+	ast_fields f;
+	ast_get_fields(copy, &f);
+	if (f.name != NULL) {
+	    *f.name = as_pointer(intern(b, *f.name) + 1);
+	}
+	// push the children (those in each field or array in reverse,
+	// so they are copied in order); each is copied after this node
+	for (int i = f.num_children - 1; i >= 0; i--) {
+	    const AST *child = *f.children[i];
+	    *f.children[i] = NULL;
+	    if (child != NULL) {
+		grow((void **) &stack, &capacity, size + 1, sizeof(pending_node));
+		stack[size++] = (pending_node) { child, index, i, 0 };
+	    }
+	}
+	for (unsigned int a = 0; a < f.num_arrays; a++) {
+	    unsigned int len = f.array_lengths[a];
+	    AST **elems = *f.arrays[a];
+	    if (len == 0) {
+		*f.arrays[a] = NULL;
+		continue;
+	    }
+	    size_t first = b->num_slots;
+	    grow((void **) &b->slots, &b->slots_capacity, first + len,
+		 sizeof(uint64_t));
+	    b->num_slots += len;
+	    *f.arrays[a] = as_pointer(first + 1);
+	    grow((void **) &stack, &capacity, size + len, sizeof(pending_node));
+	    for (unsigned int i = len; i > 0; i--) {
+		stack[size++]
+		    = (pending_node) { elems[i-1], index, -1, first + i - 1 };
+	    }
+	}
+    }
+    free(stack);
+}
+
+// Write the AST ast as an image in the file named fname
+void ast_image_write(const char *fname, const AST *ast)
+{
+    image_builder b;
+    memset(&b, 0, sizeof(b));
+    copy_nodes(&b, ast);
+
+    // now that the sizes are known, make the arrays and names offsets
+    uint64_t slots_offset = NODES_OFFSET + b.num_nodes * sizeof(AST);
+    uint64_t strings_offset = slots_offset + b.num_slots * sizeof(AST *);
+    for (size_t i = 0; i < b.num_nodes; i++) {
+	AST *node = &b.nodes[i];
+	node->file_loc.filename = as_pointer(
+	    strings_offset + as_offset(node->file_loc.filename) - 1);
+	ast_fields f;
+	ast_get_fields(node, &f);
+	if (f.name != NULL) {
+	    *f.name = as_pointer(strings_offset + as_offset(*f.name) - 1);
+	}
+	for (unsigned int a = 0; a < f.num_arrays; a++) {
+	    if (*f.arrays[a] != NULL) {
+		*f.arrays[a] = as_pointer(slots_offset
+			  + (as_offset(*f.arrays[a]) - 1) * sizeof(AST *));
+	    }
+	}
+    }
+
+    ast_image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = AST_IMAGE_VERSION;
+    header.node_size = sizeof(AST);
+    header.num_nodes = b.num_nodes;
+    header.num_slots = b.num_slots;
+    header.strings_size = b.strings_size;
+    header.root = NODES_OFFSET;
+
+    FILE *f = fopen(fname, "wb");
+    if (f == NULL) {
+	bail_with_error("Cannot create %s", fname);
+    }
+    bool okay = fwrite(&header, sizeof(header), 1, f) == 1
+	&& fwrite(b.nodes, sizeof(AST), b.num_nodes, f) == b.num_nodes;
+    // the slots hold pointers in memory, so are written in their size
+    for (size_t i = 0; okay && i < b.num_slots; i++) {
+	AST *slot = as_pointer(b.slots[i]);
+	okay = fwrite(&slot, sizeof(AST *), 1, f) == 1;
+    }
+    okay = okay
+	&& fwrite(b.strings, 1, b.strings_size, f) == b.strings_size;
+    if (fclose(f) == EOF || !okay) {
+	bail_with_error("Cannot write %s", fname);
+    }
+    free(b.nodes);
+    free(b.slots);
+    free(b.strings);
+    free(b.interned);
+}
+
+// The regions of a mapped image, for checking its offsets
+typedef struct {
+    char *base;
+    uint64_t num_nodes;
+    uint64_t slots_offset;   // where its arrays start
+    uint64_t strings_offset; // where its names start
+    uint64_t size;
+    // the arrays are in the order of the nodes that own them,
+    // and this is the offset of the first one not owned yet
+    uint64_t next_slot;
+} image_layout;
+
+// Is off the offset of a node of the given kind in the image
+// after the one at index after?
+static bool is_later_node(const image_layout *l, uint64_t off, uint64_t after,
+			  ast_kind kind)
+{
+    uint64_t first = NODES_OFFSET + (after + 1) * sizeof(AST);
+    return first <= off && off < l->slots_offset
+	&& (off - NODES_OFFSET) % sizeof(AST) == 0
+	&& is_kind(((const AST *) (l->base + off))->type_tag, kind);
+}
+
+// Is off the offset of a name in the image?
+// (The last byte of the image is '\0', so each name ends in it.)
+static bool is_name(const image_layout *l, uint64_t off)
+{
+    return l->strings_offset <= off && off < l->size;
+}
+
+// Is [off, off + len slots) in the arrays of the image
+// and not in one already owned by an earlier node?
+static bool is_array(const image_layout *l, uint64_t off, unsigned int len)
+{
+    return l->next_slot <= off && off < l->strings_offset
+	&& (off - l->slots_offset) % sizeof(AST *) == 0
+	&& len <= (l->strings_offset - off) / sizeof(AST *);
+}
+
+// Check that the node at index i of the image only refers to names
+// and arrays in it and to nodes after it (so the ASTs have no cycles)
+// of the kinds its fields hold, and relocate its pointers to where the image is mapped;
+// return whether it was valid
+static bool relocate_node(image_layout *l, uint64_t i)
+{
+    AST *node = (AST *) (l->base + NODES_OFFSET + i * sizeof(AST));
+    if ((unsigned int) node->type_tag > number_ast
+	|| !is_name(l, as_offset(node->file_loc.filename))) {
+	return false;
+    }
+    node->file_loc.filename = l->base + as_offset(node->file_loc.filename);
+    ast_fields f;
+    ast_get_fields(node, &f);
+    if (f.name != NULL) {
+	if (!is_name(l, as_offset(*f.name))) {
+	    return false;
+	}
+	*f.name = l->base + as_offset(*f.name);
+    }
+    for (unsigned int c = 0; c < f.num_children; c++) {
+	uint64_t off = as_offset(*f.children[c]);
+	if (!is_later_node(l, off, i, f.child_kinds[c])) {
+	    return false;
+	}
+	*f.children[c] = (AST *) (l->base + off);
+    }
+    for (unsigned int a = 0; a < f.num_arrays; a++) {
+	unsigned int len = f.array_lengths[a];
+	uint64_t off = as_offset(*f.arrays[a]);
+	if (len == 0) {
+	    if (node->type_tag == begin_ast) {
+		return false; // a begin has at least one statement
+	    }
+	    *f.arrays[a] = NULL;
+	    continue;
+	}
+	if (!is_array(l, off, len)) {
+	    return false;
+	}
+	l->next_slot = off + len * sizeof(AST *);
+	AST **elems = (AST **) (l->base + off);
+	for (unsigned int e = 0; e < len; e++) {
+	    uint64_t elem = as_offset(elems[e]);
+	    if (!is_later_node(l, elem, i, f.array_kinds[a])) {
+		return false;
+	    }
+	    elems[e] = (AST *) (l->base + elem);
+	}
+	*f.arrays[a] = elems;
+    }
+    return true;
+}
+
+// Unmap the image and report that the file named fname is not a valid image
+static void image_invalid(ast_image *image, const char *fname)
+{
+    ast_image_unload(image);
+    bail_with_error("%s is not a valid AST image!", fname);
+}
+
+// Map the image in the file named fname into memory, recording it in *image,
+// and return its root AST
+AST *ast_image_load(const char *fname, ast_image *image)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+	bail_with_error("Cannot open %s", fname);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	bail_with_error("Cannot read %s", fname);
+    }
+    image->base = NULL;
+    image->size = st.st_size;
+    if (image->size < sizeof(ast_image_header)) {
+	close(fd);
+	image_invalid(image, fname);
+    }
+    // a private mapping, so relocating it does not change the file
+    image->base = mmap(NULL, image->size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image->base == MAP_FAILED) {
+	image->base = NULL;
+	bail_with_error("Cannot map %s into memory", fname);
+    }
+
+    const ast_image_header *h = image->base;
+    image_layout l;
+    l.base = image->base;
+    l.size = image->size;
+    l.num_nodes = h->num_nodes;
+    if (memcmp(h->magic, AST_IMAGE_MAGIC, sizeof(h->magic)) != 0
+	|| h->version != AST_IMAGE_VERSION || h->node_size != sizeof(AST)
+	|| h->num_nodes > (l.size - NODES_OFFSET) / sizeof(AST)) {
+	image_invalid(image, fname);
+    }
+    l.slots_offset = NODES_OFFSET + h->num_nodes * sizeof(AST);
+    if (h->num_slots > (l.size - l.slots_offset) / sizeof(AST *)) {
+	image_invalid(image, fname);
+    }
+    l.strings_offset = l.slots_offset + h->num_slots * sizeof(AST *);
+    l.next_slot = l.slots_offset;
+    if (h->strings_size != l.size - l.strings_offset || h->strings_size == 0
+	|| l.base[l.size - 1] != '\0' || h->num_nodes == 0
+	|| h->root != NODES_OFFSET
+	|| ((const AST *) (l.base + h->root))->type_tag != program_ast) {
+	image_invalid(image, fname);
+    }
+    for (uint64_t i = 0; i < l.num_nodes; i++) {
+	if (!relocate_node(&l, i)) {
+	    image_invalid(image, fname);
+	}
+    }
+    return (AST *) (l.base + h->root);
+}
+
+// Unmap the image, after which none of its ASTs may be used
+void ast_image_unload(ast_image *image)
+{
+    if (image->base != NULL) {
+	munmap(image->base, image->size);
+    }
+    image->base = NULL;
+    image->size = 0;
+}
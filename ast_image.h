@@ -0,0 +1,58 @@
+#ifndef _AST_IMAGE_H
+#define _AST_IMAGE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// An AST image is a file holding a program's AST in a compact binary form
+// that is mapped into memory (with mmap) to use it again,
+// so that later runs can check or unparse a program without lexing
+// or parsing it, and without allocating anything for each node.
+// An image holds (after a header) the AST nodes, in the same form as in
+// memory, then the arrays of their children (the const-decls, var-decls,
+// and statements of programs and begin statements), then a table of
+// the names (each one only once) and file names that they use.
+// In the file, every pointer in a node or array is the offset in the file
+// of what it points to (0 for NULL); loading the image adds the address
+// of the mapping to each one, in place, in a private copy of the pages.
+// Images are only meant to be read on the kind of machine that wrote them.
+
+// The first bytes of every image
+#define AST_IMAGE_MAGIC "PL0AST\r\n"
+// The version of the image format
+#define AST_IMAGE_VERSION 1
+
+// The start of an image
+typedef struct {
+    char magic[8];          // AST_IMAGE_MAGIC (without its '\0')
+    uint32_t version;       // AST_IMAGE_VERSION
+    uint32_t node_size;     // sizeof(AST) on the machine that wrote it
+    uint64_t num_nodes;     // the number of nodes, which follow the header
+    uint64_t num_slots;     // the number of children in arrays, after them
+    uint64_t strings_size;  // the size of the names, which come last
+    uint64_t root;          // the offset of the root node
+} ast_image_header;
+
+// An image that has been loaded
+typedef struct {
+    void *base;   // where it is mapped
+    size_t size;  // its size in bytes
+} ast_image;
+
+// Requires: fname != NULL and ast != NULL
+// Write the AST ast as an image in the file named fname
+extern void ast_image_write(const char *fname, const AST *ast);
+
+// Requires: fname != NULL and image != NULL
+// Map the image in the file named fname into memory, recording it in *image,
+// and return its root AST, which stays valid until the image is unloaded.
+// (Its ASTs must not be passed to ast_free.)
+// The root must be a program with a statement, and each node must hold
+// children of the kinds its fields do (e.g., statements in a begin),
+// otherwise an error is reported.
+extern AST *ast_image_load(const char *fname, ast_image *image);
+
+// Unmap the image, after which none of its ASTs may be used
+extern void ast_image_unload(ast_image *image);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include "utilities.h"
+#include "ast_visitor.h"
+#include "alloc_list.h"
+
+// Return the number of children of ast
+unsigned int ast_num_children(AST *ast)
+{
+    switch (ast->type_tag) {
+    case program_ast:
+	return ast->data.program.num_cds + ast->data.program.num_vds + 1;
+    case begin_ast:
+	return ast->data.begin_stmt.num_stmts;
+    case if_ast:
+	return 3;
+    case while_ast:
+    case bin_cond_ast:
+    case bin_expr_ast:
+	return 2;
+    case assign_ast:
+    case write_ast:
+    case odd_cond_ast:
+    case op_expr_ast:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+// Requires: i < ast_num_children(ast)
+// Return the ith child of ast, in source order
+// (e.g., for a program, its const-decls, then its var-decls,
+// then its statement).
+AST *ast_child(AST *ast, unsigned int i)
+{
+    switch (ast->type_tag) {
+    case program_ast:
+	if (i < ast->data.program.num_cds) {
+	    return ast->data.program.cds[i];
+	}
+	i -= ast->data.program.num_cds;
+	if (i < ast->data.program.num_vds) {
+	    return ast->data.program.vds[i];
+	}
+	return ast->data.program.stmt;
+    case begin_ast:
+	return ast->data.begin_stmt.stmts[i];
+    case if_ast:
+	return (i == 0) ? ast->data.if_stmt.cond
+	    : (i == 1) ? ast->data.if_stmt.thenstmt
+	    : ast->data.if_stmt.elsestmt;
+    case while_ast:
+	return (i == 0) ? ast->data.while_stmt.cond : ast->data.while_stmt.stmt;
+    case bin_cond_ast:
+	return (i == 0) ? ast->data.bin_cond.leftexp : ast->data.bin_cond.rightexp;
+    case bin_expr_ast:
+	return (i == 0) ? ast->data.bin_expr.leftexp : ast->data.bin_expr.rightexp;
+    case assign_ast:
+	return ast->data.assign_stmt.exp;
+    case write_ast:
+	return ast->data.write_stmt.exp;
+    case odd_cond_ast:
+	return ast->data.odd_cond.exp;
+    case op_expr_ast:
+	return ast->data.op_expr.exp;
+    default:
+	bail_with_error("AST with type tag %d has no child %u!",
+			ast->type_tag, i);
+	return NULL;
+    }
+}
+
+// a node whose children are being visited
+typedef struct {
+    AST *ast;
+    unsigned int num_children;
+    unsigned int next_child; // index of the next child to visit
+    unsigned int active; // bit v is set if visitor v visits this node
+    unsigned int visiting; // bit v is set if visitor v visits the children
+} walk_frame;
+
+// Run the pre callbacks of the visitors in the bit set active on ast,
+// and return the set of those that want to visit its children
+static unsigned int walk_pre(AST *ast, ast_visitor *visitors,
+			     unsigned int num_visitors, unsigned int active)
+{
+    unsigned int ret = 0;
+    for (unsigned int v = 0; v < num_visitors; v++) {
+	unsigned int bit = 1u << v;
+	if ((active & bit)
+	    && (visitors[v].pre == NULL || visitors[v].pre(ast, visitors[v].data))) {
+	    ret |= bit;
+	}
+    }
+    return ret;
+}
+
+// Run the post callbacks of the visitors in the bit set active on ast
+static void walk_post(AST *ast, ast_visitor *visitors,
+		      unsigned int num_visitors, unsigned int active)
+{
+    for (unsigned int v = 0; v < num_visitors; v++) {
+	if ((active & (1u << v)) && visitors[v].post != NULL) {
+	    visitors[v].post(ast, visitors[v].data);
+	}
+    }
+}
+
+// Requires: num_visitors <= MAX_FUSED_VISITORS
+// Traverse ast depth-first, visiting children in source order,
+// and running the num_visitors visitors in visitors on each node
+// (in the order they are given), so several passes share one walk.
+// The traversal uses a heap-allocated stack, not recursion,
+// so its depth is only limited by memory.
+void ast_walk(AST *ast, ast_visitor *visitors, unsigned int num_visitors)
+{
+    if (num_visitors > MAX_FUSED_VISITORS) {
+	bail_with_error("Cannot fuse %u visitors into one walk!", num_visitors);
+    }
+    unsigned int all = (num_visitors == MAX_FUSED_VISITORS)
+	? ~0u : (1u << num_visitors) - 1;
+
+    unsigned int capacity = 64;
+    unsigned int size = 0;
+    walk_frame *stack = (walk_frame *) alloc_list_malloc(capacity * sizeof(walk_frame));
+    if (stack == NULL) {
+	bail_with_error("No space to walk an AST!");
+    }
+
+    // ast is the next node to enter, with visitors in the set active
+    unsigned int active = all;
+    for (;;) {
+	// enter ast
+	unsigned int visiting = walk_pre(ast, visitors, num_visitors, active);
+	unsigned int n = (visiting != 0) ? ast_num_children(ast) : 0;
+	if (size == capacity) {
+	    capacity *= 2;
+	    stack = (walk_frame *) alloc_list_realloc(stack, capacity * sizeof(walk_frame));
+	    if (stack == NULL) {
+		bail_with_error("No space to walk an AST!");
+	    }
+	}
+	stack[size].ast = ast;
+	stack[size].num_children = n;
+	stack[size].next_child = 0;
+	stack[size].active = active;
+	stack[size].visiting = visiting;
+	size++;
+
+	// leave nodes until one has another child to enter
+	for (;;) {
+	    walk_frame *f = &stack[size-1];
+	    if (f->next_child < f->num_children) {
+		ast = ast_child(f->ast, f->next_child++);
+		// only visitors that visit the parent's children go down
+		active = f->visiting;
+		break;
+	    }
+	    walk_post(f->ast, visitors, num_visitors, f->active);
+	    size--;
+	    if (size == 0) {
+		alloc_list_free(stack);
+		return;
+	    }
+	}
+    }
+}
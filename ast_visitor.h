@@ -0,0 +1,40 @@
+#ifndef _AST_VISITOR_H
+#define _AST_VISITOR_H
+#include <stdbool.h>
+#include "ast.h"
+
+// Maximum number of visitors that can share one traversal
+#define MAX_FUSED_VISITORS 32
+
+// A visitor is a pass over an AST, given as callbacks
+// that a traversal calls on each node it reaches.
+// pre is called on a node before its children are visited
+// and post is called on it after them; either may be NULL.
+// If pre returns false, this visitor does not visit that node's children
+// (but its post is still called on the node).
+// The data pointer is passed to every call, for the pass's own state.
+typedef struct {
+    bool (*pre)(AST *ast, void *data);
+    void (*post)(AST *ast, void *data);
+    void *data;
+} ast_visitor;
+
+// Return the number of children of ast
+extern unsigned int ast_num_children(AST *ast);
+
+// Requires: i < ast_num_children(ast)
+// Return the ith child of ast, in source order
+// (e.g., for a program, its const-decls, then its var-decls,
+// then its statement).
+extern AST *ast_child(AST *ast, unsigned int i);
+
+// Requires: num_visitors <= MAX_FUSED_VISITORS
+// Traverse ast depth-first, visiting children in source order,
+// and running the num_visitors visitors in visitors on each node
+// (in the order they are given), so several passes share one walk.
+// The traversal uses a heap-allocated stack, not recursion,
+// so its depth is only limited by memory.
+extern void ast_walk(AST *ast, ast_visitor *visitors,
+		     unsigned int num_visitors);
+
+#endif
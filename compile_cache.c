@@ -0,0 +1,385 @@
+// a cache of what compiling programs printed (see compile_cache.h)
+// for utimensat, mkdir, pread, and pwrite
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compile_cache.h"
+
+// A hash of the compiler's sources, which the Makefile defines,
+// so that the key changes whenever the compiler's code does
+// (but not when the same code is built again)
+#ifndef COMPILER_SOURCES_HASH
+#define COMPILER_SOURCES_HASH "unknown"
+#endif
+
+// The compiler's version, which is part of every key,
+// so that a changed compiler never uses what an older one printed.
+// (A compiler built without the Makefile does not know its sources' hash,
+// so its cache should be removed when its code changes.)
+static const char compiler_version[] = "pl0 " COMPILER_SOURCES_HASH;
+
+// Suffix of the names of the files that hold entries
+#define CACHE_ENTRY_SUFFIX ".pl0c"
+// Name of the file holding the hit and miss counts
+#define CACHE_STATS_NAME "stats"
+// Suffix of the name of a file written before it replaces another
+#define CACHE_TEMP_SUFFIX ".tmp"
+// Maximum length of the path of a file in a cache
+#define CACHE_PATH_SIZE 4096
+
+// Primes used by the hash function (those of xxHash's 64-bit hash)
+#define PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME3 UINT64_C(0x165667B19E3779F9)
+#define PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME5 UINT64_C(0x27D4EB2F165667C5)
+
+// Return x rotated left by r bits
+static uint64_t rotl64(uint64_t x, unsigned int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Return the len bytes at p hashed, starting from seed,
+// in the way xxHash's 64-bit hash handles short inputs
+// (eight bytes at a time, with the same mixing steps)
+static uint64_t hash_bytes(const void *p, size_t len, uint64_t seed)
+{
+    const unsigned char *bytes = p;
+    const unsigned char *end = bytes + len;
+    uint64_t h = seed + PRIME5 + (uint64_t) len;
+    while (bytes + 8 <= end) {
+	uint64_t k;
+	memcpy(&k, bytes, 8);
+	k = rotl64(k * PRIME2, 31) * PRIME1;
+	h = rotl64(h ^ k, 27) * PRIME1 + PRIME4;
+	bytes += 8;
+    }
+    if (bytes + 4 <= end) {
+	uint32_t k;
+	memcpy(&k, bytes, 4);
+	h = rotl64(h ^ ((uint64_t) k * PRIME1), 23) * PRIME2 + PRIME3;
+	bytes += 4;
+    }
+    while (bytes < end) {
+	h = rotl64(h ^ (*bytes * PRIME5), 11) * PRIME1;
+	bytes++;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Return the key of the program named name, whose text is the len chars
+// in text, when compiled by this version of the compiler
+uint64_t cache_key(const char *name, const char *text, size_t len)
+{
+    uint64_t h = hash_bytes(compiler_version, sizeof(compiler_version), 0);
+    h = hash_bytes(name, strlen(name) + 1, h);
+    return hash_bytes(text, len, h);
+}
+
+// Put in path the path of the file in dir that holds the entry for key
+static void entry_path(char *path, const char *dir, uint64_t key)
+{
+    snprintf(path, CACHE_PATH_SIZE, "%s/%016" PRIx64 CACHE_ENTRY_SUFFIX,
+	     dir, key);
+}
+
+// Open the file holding the hit and miss counts of the cache in dir
+// (creating it, if create) and lock it (for writing, if create),
+// waiting for any other compilers that have it locked,
+// and return its file descriptor, or -1 if that cannot be done
+static int open_stats(const char *dir, bool create)
+{
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/" CACHE_STATS_NAME, dir);
+    int fd = open(path, create ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+    if (fd < 0) {
+	return -1;
+    }
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = create ? F_WRLCK : F_RDLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+	if (errno != EINTR) {
+	    close(fd);
+	    return -1;
+	}
+    }
+    return fd;
+}
+
+// Read the hit and miss counts from the stats file open as fd
+// into *hits and *misses (which are 0 if they have not been saved)
+static void read_counts(int fd, unsigned long *hits, unsigned long *misses)
+{
+    char counts[64];
+    ssize_t n = pread(fd, counts, sizeof(counts) - 1, 0);
+    counts[(n > 0) ? n : 0] = '\0';
+    if (sscanf(counts, "hits %lu misses %lu", hits, misses) != 2) {
+	*hits = 0;
+	*misses = 0;
+    }
+}
+
+// Read the hit and miss counts of the cache in dir into *hits and *misses
+// (which are 0 if they have not been saved)
+static void read_stats(const char *dir, unsigned long *hits,
+		       unsigned long *misses)
+{
+    *hits = 0;
+    *misses = 0;
+    int fd = open_stats(dir, false);
+    if (fd < 0) {
+	return;
+    }
+    read_counts(fd, hits, misses);
+    close(fd);
+}
+
+// Make the contents of the file named path be header followed by
+// the len1 chars in text1 and the len2 chars in text2,
+// by writing a new file and renaming it over path,
+// and return whether that worked
+static bool write_file(const char *path, const char *header,
+		       const char *text1, size_t len1,
+		       const char *text2, size_t len2)
+{
+    // the process id keeps compilers storing the same entry at once apart
+    char tmppath[CACHE_PATH_SIZE + 32];
+    snprintf(tmppath, sizeof(tmppath), "%s.%ld" CACHE_TEMP_SUFFIX, path,
+	     (long) getpid());
+    FILE *f = fopen(tmppath, "w");
+    if (f == NULL) {
+	return false;
+    }
+    bool okay = fputs(header, f) != EOF
+	&& (len1 == 0 || fwrite(text1, 1, len1, f) == len1)
+	&& (len2 == 0 || fwrite(text2, 1, len2, f) == len2);
+    if (fclose(f) == EOF || !okay || rename(tmppath, path) != 0) {
+	remove(tmppath);
+	return false;
+    }
+    return true;
+}
+
+// Count a hit (if hit) or a miss for the cache in dir,
+// holding the lock on the counts while they are read and rewritten,
+// so that no count is lost when several compilers use the cache at once
+static void count_lookup(const char *dir, bool hit)
+{
+    int fd = open_stats(dir, true);
+    if (fd < 0) {
+	return;
+    }
+    unsigned long hits, misses;
+    read_counts(fd, &hits, &misses);
+    if (hit) {
+	hits++;
+    } else {
+	misses++;
+    }
+    char counts[64];
+    int len = snprintf(counts, sizeof(counts), "hits %lu\nmisses %lu\n",
+		       hits, misses);
+    if (ftruncate(fd, 0) == 0) {
+	ssize_t written = pwrite(fd, counts, len, 0);
+	(void) written;
+    }
+    close(fd);  // which releases the lock
+}
+
+// Read the entry in the file named path into *entry
+// and return whether that worked
+static bool read_entry(const char *path, cache_entry *entry)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+	return false;
+    }
+    entry->out = NULL;
+    entry->err = NULL;
+    bool okay = fscanf(f, "pl0c %d %zu %zu", &entry->status,
+		       &entry->out_len, &entry->err_len) == 3
+	&& fgetc(f) == '\n';
+    if (okay) {
+	entry->out = malloc(entry->out_len + 1);
+	entry->err = malloc(entry->err_len + 1);
+	okay = entry->out != NULL && entry->err != NULL
+	    && fread(entry->out, 1, entry->out_len, f) == entry->out_len
+	    && fread(entry->err, 1, entry->err_len, f) == entry->err_len
+	    && fgetc(f) == EOF;
+    }
+    fclose(f);
+    if (!okay) {
+	cache_entry_free(entry);
+    }
+    return okay;
+}
+
+// If the cache in directory dir has an entry for key, set *entry to it,
+// count a hit, and return true; otherwise count a miss and return false
+bool cache_load(const char *dir, uint64_t key, cache_entry *entry)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+	errno = 0;
+	return false;
+    }
+    char path[CACHE_PATH_SIZE];
+    entry_path(path, dir, key);
+    bool hit = read_entry(path, entry);
+    if (hit) {
+	// mark it as recently used, so it is removed last
+	utimensat(AT_FDCWD, path, NULL, 0);
+    }
+    count_lookup(dir, hit);
+    errno = 0;
+    return hit;
+}
+
+// A file holding an entry, for deciding which entries to remove
+typedef struct {
+    char *name;
+    off_t size;
+    struct timespec used;
+} entry_file;
+
+// Compare entry files by when they were used, least recently first
+static int compare_use(const void *a, const void *b)
+{
+    const struct timespec *ua = &((const entry_file *) a)->used;
+    const struct timespec *ub = &((const entry_file *) b)->used;
+    if (ua->tv_sec != ub->tv_sec) {
+	return ua->tv_sec < ub->tv_sec ? -1 : 1;
+    }
+    if (ua->tv_nsec != ub->tv_nsec) {
+	return ua->tv_nsec < ub->tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+// Set *files to the (malloc'd) array of the entry files in dir,
+// and *total to the sum of their sizes,
+// and return the number of them
+static size_t list_entries(const char *dir, entry_file **files, off_t *total)
+{
+    *files = NULL;
+    *total = 0;
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+	return 0;
+    }
+    size_t count = 0, capacity = 0;
+    size_t suffix_len = strlen(CACHE_ENTRY_SUFFIX);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+	size_t len = strlen(de->d_name);
+	if (len <= suffix_len
+	    || strcmp(de->d_name + len - suffix_len, CACHE_ENTRY_SUFFIX) != 0) {
+	    continue;
+	}
+	char path[CACHE_PATH_SIZE];
+	struct stat st;
+	snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+	if (stat(path, &st) != 0) {
+	    continue;
+	}
+	if (count == capacity) {
+	    capacity = (capacity == 0) ? 64 : 2 * capacity;
+	    entry_file *bigger = realloc(*files, capacity * sizeof(entry_file));
+	    if (bigger == NULL) {
+		break;
+	    }
+	    *files = bigger;
+	}
+	(*files)[count].name = strdup(de->d_name);
+	if ((*files)[count].name == NULL) {
+	    break;
+	}
+	(*files)[count].size = st.st_size;
+	(*files)[count].used = st.st_mtim;
+	*total += st.st_size;
+	count++;
+    }
+    closedir(d);
+    return count;
+}
+
+// Remove the least recently used entries of the cache in dir
+// until they take at most max_size bytes
+static void evict(const char *dir, size_t max_size)
+{
+    entry_file *files;
+    off_t total;
+    size_t count = list_entries(dir, &files, &total);
+    if ((size_t) total > max_size) {
+	qsort(files, count, sizeof(entry_file), compare_use);
+	for (size_t i = 0; i < count && (size_t) total > max_size; i++) {
+	    char path[CACHE_PATH_SIZE];
+	    snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+	    if (remove(path) == 0) {
+		total -= files[i].size;
+	    }
+	}
+    }
+    for (size_t i = 0; i < count; i++) {
+	free(files[i].name);
+    }
+    free(files);
+}
+
+// Save entry as the one for key in the cache in directory dir,
+// then remove the least recently used entries
+// until they take at most max_size bytes
+void cache_store(const char *dir, uint64_t key, const cache_entry *entry,
+		 size_t max_size)
+{
+    char path[CACHE_PATH_SIZE];
+    char header[64];
+    entry_path(path, dir, key);
+    snprintf(header, sizeof(header), "pl0c %d %zu %zu\n", entry->status,
+	     entry->out_len, entry->err_len);
+    if (write_file(path, header, entry->out, entry->out_len,
+		   entry->err, entry->err_len)) {
+	evict(dir, max_size);
+    }
+    errno = 0;
+}
+
+// Free the texts in entry
+void cache_entry_free(cache_entry *entry)
+{
+    free(entry->out);
+    free(entry->err);
+    entry->out = NULL;
+    entry->err = NULL;
+}
+
+// Print on out the number of hits and misses
+// and the number and total size of the entries of the cache in dir
+void cache_print_stats(FILE *out, const char *dir)
+{
+    unsigned long hits, misses;
+    read_stats(dir, &hits, &misses);
+    entry_file *files;
+    off_t total;
+    size_t count = list_entries(dir, &files, &total);
+    for (size_t i = 0; i < count; i++) {
+	free(files[i].name);
+    }
+    free(files);
+    fprintf(out, "hits: %lu\nmisses: %lu\nentries: %zu\nbytes: %lld\n",
+	    hits, misses, count, (long long) total);
+}
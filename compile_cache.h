@@ -0,0 +1,56 @@
+#ifndef _COMPILE_CACHE_H
+#define _COMPILE_CACHE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A compile cache is a directory holding what compiling programs
+// printed (and the exit status), keyed by a hash of the program's text,
+// its name, and the compiler's version (a hash of its sources),
+// so that compiling a program that was compiled before
+// just prints what was saved.
+// Several compilers may use the same cache at once.
+// When the files in the directory take more than its size limit,
+// the least recently used ones are removed.
+// The cache is only an optimization: if it cannot be read or written,
+// the program is compiled as usual.
+
+// The default limit on the size of a cache's entries, in bytes
+#define CACHE_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+// What compiling a program printed
+typedef struct {
+    int status;      // the exit status
+    char *out;       // what was printed on stdout (out_len chars)
+    size_t out_len;
+    char *err;       // what was printed on stderr (err_len chars)
+    size_t err_len;
+} cache_entry;
+
+// Return the key of the program named name, whose text is the len chars
+// in text, when compiled by this version of the compiler
+extern uint64_t cache_key(const char *name, const char *text, size_t len);
+
+// Requires: dir != NULL and entry != NULL
+// If the cache in directory dir (which is created if needed)
+// has an entry for key, set *entry to it (to be freed with cache_entry_free),
+// count a hit, and return true; otherwise count a miss and return false.
+extern bool cache_load(const char *dir, uint64_t key, cache_entry *entry);
+
+// Requires: dir != NULL and entry != NULL
+// Save entry as the one for key in the cache in directory dir,
+// then remove the least recently used entries
+// until they take at most max_size bytes
+extern void cache_store(const char *dir, uint64_t key,
+			const cache_entry *entry, size_t max_size);
+
+// Free the texts in entry
+extern void cache_entry_free(cache_entry *entry);
+
+// Print on out the number of hits and misses
+// and the number and total size of the entries
+// of the cache in directory dir
+extern void cache_print_stats(FILE *out, const char *dir);
+
+#endif
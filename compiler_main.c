@@ -1,24 +1,380 @@
 // By: Vincent Lazo, Christian Manuel
 // main file, calls parser and declaration checking functions
 
+// for open_memstream
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lexer.h"
+#include "lexer_output.h"
 #include "ast.h"
 #include "parser.h"
 #include "unparser.h"
+#include "formatter.h"
 #include "scope_check.h"
 #include "scope_symtab.h"
+#include "libpl0.h"
+#include "compile_cache.h"
+#include "ast_image.h"
+#include "watcher.h"
 
 
+// the stages of the compiler that a run uses
+typedef enum {
+	unparse_and_check_mode,	// (the default) parse, unparse, then check
+	check_mode,				// parse and check in one pass, without output
+	unparse_mode,			// parse and unparse, without checking
+	stream_mode,			// parse, unparse, and check a statement at a time
+	tokens_mode,			// only lex, printing the tokens
+	format_mode				// rewrite files in canonical form
+} compiler_mode;
+
+// print a message about how to use this program on stderr and exit
+static void usage(const char *cmdname)
+{
+	fprintf(stderr, "Usage: %s [--check | --unparse | --stream | --tokens]"
+		" [--threads N] file.pl0\n", cmdname);
+	fprintf(stderr, "   or: %s --format file.pl0 ...\n", cmdname);
+	fprintf(stderr, "   or: %s --cache DIR [--cache-size BYTES] file.pl0\n", cmdname);
+	fprintf(stderr, "   or: %s --cache DIR --cache-stats\n", cmdname);
+	fprintf(stderr, "   or: %s [--check | --unparse] --load-ast file.ast\n", cmdname);
+	fprintf(stderr, "   or: %s [--threads N] --watch DIR\n", cmdname);
+	fprintf(stderr, "  (with no option, unparse and then check the program;"
+		" a file named - is\n   the standard input)\n");
+	fprintf(stderr, "  --check    only check the program, while parsing it,"
+		" without unparsing it\n");
+	fprintf(stderr, "  --unparse  only unparse the program, without checking it\n");
+	fprintf(stderr, "  --stream   unparse and check each statement of the program's"
+		" begin\n             statement as soon as it is parsed,"
+		" then free it\n");
+	fprintf(stderr, "  --tokens   only print the program's tokens\n");
+	fprintf(stderr, "  --format   rewrite each file in canonical form"
+		" (printing the names of those that change)\n");
+	fprintf(stderr, "  --threads N  use N threads for the work that can be"
+		" split up\n");
+	fprintf(stderr, "  --save-ast FILE  also write the program's AST"
+		" as an image in FILE\n");
+	fprintf(stderr, "  --load-ast  the file is an AST image"
+		" (from --save-ast), not a program\n");
+	fprintf(stderr, "  --watch DIR  stay running, and unparse and check each .pl0"
+		" file in DIR\n             (or a directory in it) each time"
+		" it is saved\n");
+	fprintf(stderr, "  --cache DIR  reuse what was printed when the same program"
+		" was compiled\n             before, as saved in the directory DIR\n");
+	fprintf(stderr, "  --cache-size BYTES  keep at most BYTES of saved output"
+		" in the cache\n");
+	fprintf(stderr, "  --cache-stats  print the cache's hits, misses,"
+		" and size\n");
+	exit(EXIT_FAILURE);
+}
+
+// Return the number of threads given by the argument arg of --threads,
+// or print a usage message and exit if it is not a positive number
+static unsigned int arg2threads(const char *cmdname, const char *arg)
+{
+	char *end;
+	long n = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || n < 1 || n > 1024)
+		usage(cmdname);
+	return (unsigned int) n;
+}
+
+// Return the size given by the argument arg of --cache-size,
+// or print a usage message and exit if it is not a positive number
+static size_t arg2size(const char *cmdname, const char *arg)
+{
+	char *end;
+	unsigned long long n = strtoull(arg, &end, 10);
+	if (!isdigit((unsigned char) *arg) || *end != '\0' || n < 1 || n > SIZE_MAX)
+		usage(cmdname);
+	return (size_t) n;
+}
+
+// parse the file named fname and check its declarations
+// in a single pass, with no output unless there is an error;
+// scope errors are only reported once the whole program has parsed,
+// so the error reported is the same as when checking after parsing
+static void check_only(const char *fname)
+{
+	scope_initialize();
+	parser_set_scope_checking(true);
+	defer_semantic_errors(true);
+
+	parser_open(fname);
+	parseyParse();
+	parser_close();
+
+	defer_semantic_errors(false);
+	report_deferred_error();
+}
+
+// unparse the statement stmt (indented for level, and followed
+// by a semicolon if addSemiToEnd), check it, and then free it
+static void stream_stmt(AST *stmt, int level, bool addSemiToEnd)
+{
+	unparseStmt(stdout, stmt, level, addSemiToEnd);
+	scope_check_stmt(stmt);
+	ast_free(stmt);
+}
+
+// parse the file named fname, unparsing and checking
+// each statement of the program's begin statement as soon as it is parsed,
+// and then freeing it, so that only the declarations
+// and one statement's AST are in memory at a time
+// (semantic errors are deferred to the end, as in check_only,
+// so the error reported is the same as without streaming,
+// even when a syntax error comes after a semantic one)
+static void stream_compile(const char *fname)
+{
+	defer_semantic_errors(true);
+	parser_open(fname);
+	AST *prog = parseDeclsOnly();
+
+	unparseConstDecls(stdout, prog->data.program.num_cds, prog->data.program.cds, 0);
+	unparseVarDecls(stdout, prog->data.program.num_vds, prog->data.program.vds, 0);
+	scope_initialize();
+	scope_check_constDecls(prog->data.program.num_cds, prog->data.program.cds);
+	scope_check_varDecls(prog->data.program.num_vds, prog->data.program.vds);
+
+	if (parseStreamBegin())
+	{
+		unparseBeginOpen(stdout, 0);
+		bool is_last = false;
+		while (!is_last)
+		{
+			AST *stmt = parseStreamStmt(&is_last);
+			stream_stmt(stmt, 1, !is_last);
+		}
+		unparseBeginClose(stdout, 0, false);
+	}
+	else
+	{
+		stream_stmt(parseStmt(), 0, false);
+	}
+
+	parseProgramEnd();
+	parser_close();
+	unparseProgramEnd(stdout);
+
+	defer_semantic_errors(false);
+	report_deferred_error();
+}
+
+// unparse and check the program named name, whose text is the len chars
+// in text, printing on out and err what the compiler prints for it
+// on stdout and stderr (but without exiting if it has an error),
+// and return the compiler's exit status for it
+static int compile_and_print(const char *text, size_t len, const char *name,
+							 FILE *out, FILE *err)
+{
+	pl0_result *result = pl0_compile(text, len, name);
+	if (result == NULL)
+		bail_with_error("No space to compile %s", name);
+
+	if (result->ast != NULL)
+		unparseProgram(out, result->ast);
+	fflush(out);
+	for (unsigned int d = 0; d < result->num_diagnostics; d++)
+	{
+		pl0_diagnostic diag = result->diagnostics[d];
+		if (diag.loc.filename != NULL)
+			fprintf(err, "%s: line %d, column %d: ",
+					diag.loc.filename, diag.loc.line, diag.loc.column);
+		fprintf(err, "%s\n", diag.message);
+	}
+	fflush(err);
+	int status = (result->num_diagnostics == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	pl0_result_free(result);
+	return status;
+}
+
+// set *entry to what unparsing and checking the program named name,
+// whose text is the len chars in text, prints (and its exit status)
+static void compile_to_entry(const char *text, size_t len, const char *name,
+							 cache_entry *entry)
+{
+	FILE *out = open_memstream(&entry->out, &entry->out_len);
+	FILE *err = open_memstream(&entry->err, &entry->err_len);
+	if (out == NULL || err == NULL)
+		bail_with_error("Unable to create a buffer to compile %s", name);
+	entry->status = compile_and_print(text, len, name, out, err);
+	fclose(out);
+	fclose(err);
+}
+
+// unparse and check the file named fname, which has just been written,
+// whose text is the len chars in text, printing its name and then
+// what the compiler prints for it (for --watch)
+static void compile_written_file(const char *fname, const char *text, size_t len)
+{
+	printf("==> %s <==\n", fname);
+	compile_and_print(text, len, fname, stdout, stderr);
+}
+
+// unparse and check the file named fname, unless the cache in directory dir
+// has what that printed before, and print what it prints;
+// return the exit status of compiling it
+static int cached_compile(const char *fname, const char *dir, size_t max_size)
+{
+	size_t len;
+	char *text = lexer_read_file(fname, &len);
+	const char *name = (strcmp(fname, "-") == 0) ? LEXER_STDIN_NAME : fname;
+	uint64_t key = cache_key(name, text, len);
+
+	cache_entry entry;
+	if (!cache_load(dir, key, &entry))
+	{
+		compile_to_entry(text, len, name, &entry);
+		cache_store(dir, key, &entry, max_size);
+	}
+	free(text);
+
+	fwrite(entry.out, 1, entry.out_len, stdout);
+	fflush(stdout);
+	fwrite(entry.err, 1, entry.err_len, stderr);
+	fflush(stderr);
+	int status = entry.status;
+	cache_entry_free(&entry);
+	return status;
+}
+
 int main(int argc, char *argv[])
 {
+	compiler_mode mode = unparse_and_check_mode;
+	unsigned int num_threads = 1;
+	const char *cache_dir = NULL;
+	size_t cache_max_size = CACHE_DEFAULT_MAX_SIZE;
+	bool print_cache_stats = false;
+	const char *save_ast_name = NULL;
+	bool load_ast = false;
+	const char *watch_dir = NULL;
+
+	// the options come first, then the file names
+	int i;
+	for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++)
+	{
+		if (strcmp(argv[i], "--check") == 0)
+			mode = check_mode;
+		else if (strcmp(argv[i], "--unparse") == 0)
+			mode = unparse_mode;
+		else if (strcmp(argv[i], "--stream") == 0)
+			mode = stream_mode;
+		else if (strcmp(argv[i], "--tokens") == 0)
+			mode = tokens_mode;
+		else if (strcmp(argv[i], "--format") == 0)
+			mode = format_mode;
+		else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+			num_threads = arg2threads(argv[0], argv[++i]);
+		else if (strcmp(argv[i], "--cache") == 0 && i+1 < argc)
+			cache_dir = argv[++i];
+		else if (strcmp(argv[i], "--cache-size") == 0 && i+1 < argc)
+			cache_max_size = arg2size(argv[0], argv[++i]);
+		else if (strcmp(argv[i], "--cache-stats") == 0)
+			print_cache_stats = true;
+		else if (strcmp(argv[i], "--save-ast") == 0 && i+1 < argc)
+			save_ast_name = argv[++i];
+		else if (strcmp(argv[i], "--load-ast") == 0)
+			load_ast = true;
+		else if (strcmp(argv[i], "--watch") == 0 && i+1 < argc)
+			watch_dir = argv[++i];
+		else
+			usage(argv[0]);
+	}
+
+	lexer_set_threads(num_threads);
+	parser_set_threads(num_threads);
+	unparser_set_threads(num_threads);
+	scope_check_set_threads(num_threads);
+
+	if (mode == format_mode)
+	{
+		if (i == argc)
+			usage(argv[0]);
+		for (; i < argc; i++)
+		{
+			if (format_file(argv[i]))
+				printf("%s\n", argv[i]);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// watching compiles each file that is written in the default mode
+	if (watch_dir != NULL)
+	{
+		if (mode != unparse_and_check_mode || cache_dir != NULL
+			|| save_ast_name != NULL || load_ast || i != argc)
+			usage(argv[0]);
+		watch_directory(watch_dir, compile_written_file);
+		return EXIT_FAILURE;
+	}
+
+	// the cache only holds what the default mode prints
+	if (cache_dir != NULL && mode != unparse_and_check_mode)
+		usage(argv[0]);
+	if (print_cache_stats)
+	{
+		if (cache_dir == NULL || i != argc)
+			usage(argv[0]);
+		cache_print_stats(stdout, cache_dir);
+		return EXIT_SUCCESS;
+	}
+
+	// AST images hold a whole program's AST, which only some modes build
+	bool whole_ast = mode == unparse_and_check_mode || mode == unparse_mode
+		|| (mode == check_mode && load_ast);
+	if ((save_ast_name != NULL || load_ast) && (cache_dir != NULL || !whole_ast))
+		usage(argv[0]);
+
+	// the other modes work on a single file
+	if (i != argc-1)
+		usage(argv[0]);
+	const char *fname = argv[i];
+
+	if (cache_dir != NULL)
+		return cached_compile(fname, cache_dir, cache_max_size);
+
+	if (load_ast)
+	{
+		ast_image image;
+		AST *progAST = ast_image_load(fname, &image);
+		if (save_ast_name != NULL)
+			ast_image_write(save_ast_name, progAST);
+		if (mode != check_mode)
+			unparseProgram(stdout, progAST);
+		if (mode != unparse_mode)
+		{
+			scope_initialize();
+			scope_check_program(progAST);
+		}
+		ast_image_unload(&image);
+		return EXIT_SUCCESS;
+	}
+
+	if (mode == check_mode)
+	{
+		check_only(fname);
+		return EXIT_SUCCESS;
+	}
+	else if (mode == stream_mode)
+	{
+		stream_compile(fname);
+		return EXIT_SUCCESS;
+	}
+	else if (mode == tokens_mode)
+	{
+		lexer_open(fname);
+		lexer_output();
+		lexer_close();
+		return EXIT_SUCCESS;
+	}
+
 	// open input file (lexer_open)/ initialize parser
-	parser_open(argv[1]);
+	parser_open(fname);
 
 	// parse program, return ptr to AST (progAST) 
 	AST *progAST = parseyParse();
@@ -26,9 +382,15 @@ int main(int argc, char *argv[])
 	// close input file (lexer_close)
 	parser_close();
 
+	if (save_ast_name != NULL)
+		ast_image_write(save_ast_name, progAST);
+
 	// unparse program with arguments from stdout and progAST
 	unparseProgram(stdout, progAST);
 
+	if (mode == unparse_mode)
+		return EXIT_SUCCESS;
+
 	// initialize symbol table
 	scope_initialize();
 
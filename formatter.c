@@ -0,0 +1,132 @@
+// format PL/0 source files in place, in the canonical form of the unparser
+// for open_memstream, mkstemp, fdopen, and fchmod
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "formatter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "unparser.h"
+#include "utilities.h"
+
+// Suffix of the name of the file written before it replaces the original
+// (a template for mkstemp, which makes the name unique)
+#define FORMAT_TEMP_SUFFIX ".fmt-XXXXXX"
+
+// Return the formatted text of the program in the file named fname
+// (malloc'd), setting *len to its length
+static char *format_program(const char *fname, size_t *len)
+{
+    lexer_set_comment_recording(true);
+    parser_open(fname);
+    AST *prog = parseyParse();
+    parser_close();
+    lexer_set_comment_recording(false);
+
+    unsigned int num_comments;
+    lexer_comment *comments = lexer_take_comments(&num_comments);
+
+    char *text = NULL;
+    FILE *mem = open_memstream(&text, len);
+    if (mem == NULL) {
+	bail_with_error("Unable to create a buffer to format %s", fname);
+    }
+    unparser_set_minimal_parens(true);
+    unparser_set_comments(num_comments, comments);
+    unparseProgram(mem, prog);
+    unparser_set_comments(0, NULL);
+    unparser_set_minimal_parens(false);
+    fclose(mem);
+
+    for (unsigned int i = 0; i < num_comments; i++) {
+	free(comments[i].text);
+    }
+    free(comments);
+    ast_free(prog);
+    return text;
+}
+
+// Does the file named fname contain exactly the len chars in text?
+static bool file_has_contents(const char *fname, const char *text, size_t len)
+{
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+	bail_with_error("Cannot open %s", fname);
+    }
+    char buf[BUFSIZ];
+    size_t pos = 0;
+    bool same = true;
+    size_t n;
+    while (same && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+	same = pos + n <= len && memcmp(buf, text + pos, n) == 0;
+	pos += n;
+    }
+    fclose(f);
+    return same && pos == len;
+}
+
+// Replace the contents of the file named fname with the len chars in text,
+// by writing them to a new file (with the same mode as fname) next to it
+// and renaming that over fname, so that fname is never left partly written
+static void replace_file_contents(const char *fname, const char *text,
+				  size_t len)
+{
+    struct stat st;
+    if (stat(fname, &st) != 0) {
+	bail_with_error("Cannot read %s", fname);
+    }
+    size_t namelen = strlen(fname);
+    char *tmpname = malloc(namelen + sizeof(FORMAT_TEMP_SUFFIX));
+    if (tmpname == NULL) {
+	bail_with_error("No space to format %s", fname);
+    }
+    memcpy(tmpname, fname, namelen);
+    memcpy(tmpname + namelen, FORMAT_TEMP_SUFFIX, sizeof(FORMAT_TEMP_SUFFIX));
+
+    int fd = mkstemp(tmpname);
+    if (fd < 0) {
+	bail_with_error("Cannot create %s", tmpname);
+    }
+    FILE *f = fdopen(fd, "w");
+    if (f == NULL) {
+	close(fd);
+	remove(tmpname);
+	bail_with_error("Cannot create %s", tmpname);
+    }
+    bool okay = fchmod(fd, st.st_mode & 07777) == 0
+	&& fwrite(text, 1, len, f) == len;
+    if (fclose(f) == EOF || !okay) {
+	remove(tmpname);
+	bail_with_error("Cannot write %s", tmpname);
+    }
+    if (rename(tmpname, fname) != 0) {
+	remove(tmpname);
+	bail_with_error("Cannot replace %s", fname);
+    }
+    free(tmpname);
+}
+
+// Format the PL/0 program in the file named fname in the canonical form,
+// rewriting the file only if this changes its contents,
+// and return whether it was rewritten
+// (if fname is "-", read the standard input and write the standard output)
+bool format_file(const char *fname)
+{
+    size_t len;
+    char *text = format_program(fname, &len);
+    if (strcmp(fname, "-") == 0) {
+	// a filter: the formatted program goes to the standard output
+	fwrite(text, 1, len, stdout);
+	free(text);
+	return false;
+    }
+    bool changed = !file_has_contents(fname, text, len);
+    if (changed) {
+	replace_file_contents(fname, text, len);
+    }
+    free(text);
+    return changed;
+}
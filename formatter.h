@@ -0,0 +1,18 @@
+#ifndef _FORMATTER_H
+#define _FORMATTER_H
+#include <stdbool.h>
+
+// Requires: fname != NULL
+// Requires: fname is the name of a readable and writable file
+// Format the PL/0 program in the file named fname in the canonical form:
+// as the unparser prints it, but with only the parentheses needed
+// and with the program's comments kept.
+// The file is only rewritten if this changes its contents;
+// return whether it was rewritten.
+// If fname is "-", the program is read from the standard input
+// and its formatted text is written to the standard output
+// (and false is returned).
+// (Syntax errors are reported as usual, and the file is not changed.)
+extern bool format_file(const char *fname);
+
+#endif
@@ -1,61 +1,315 @@
 /* $Id: lexer.c,v 1.10 2023/02/24 17:12:16 leavens Exp leavens $ */
+// for pthreads
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
 #include "token.h"
 #include "utilities.h"
 #include "lexer.h"
 #include "reserved.h"
+#include "alloc_list.h"
 
-// The input file
-static FILE *input_file = NULL;
+// The contents of the input file
+// (read all at once, so the lexer scans memory, not a stdio stream),
+// or the caller's buffer (see lexer_open_buffer)
+static const char *input = NULL;
+// Does the lexer own input (so it must free it when closed)?
+static bool input_owned = false;
+// The number of chars in input
+static size_t input_len = 0;
+// The index in input of the next char to be read
+// (each thread lexing part of the input in parallel has its own)
+static _Thread_local size_t pos = 0;
+// The offsets in input at which each line starts
+// (so line_starts[0] == 0), used to find the line and column
+// of a token from its offset
+static unsigned int *line_starts = NULL;
+// The number of elements in line_starts
+static unsigned int num_lines = 0;
 // The input file's name
 static const char *filename = NULL;
 // Is this token stream done (past EOF or error)?
 static bool done = true;
-// the line of the next token
-static unsigned int line;
-// the column of the next token
-static unsigned int column;
+// Are the comments being recorded?
+static bool recording_comments = false;
+// The comments recorded since the lexer was opened
+static lexer_comment *comments = NULL;
+// The number of elements in comments and the number it has room for
+static unsigned int num_comments = 0;
+static unsigned int comments_capacity = 0;
+// The number of end tokens lexed (only counted while recording comments,
+// so that each comment can record how many come before it)
+static unsigned int num_ends = 0;
+
+// Number of threads to lex a large file with (see lexer_set_threads)
+static unsigned int lex_threads = 1;
+// Files smaller than this are always lexed by a single thread
+#define PARALLEL_LEX_MIN_SIZE (1 << 16)
+
+// When a file is lexed in parallel, all of its tokens are lexed at open
+// and kept in prelexed (which has num_prelexed elements),
+// and lexer_next_compact returns them in order (next_prelexed is the index
+// of the next one). If there was a lexical error, the tokens before it
+// are kept, and the error is reported when they have all been returned.
+static bool is_prelexed = false;
+static compact_token *prelexed = NULL;
+static unsigned int num_prelexed = 0;
+static unsigned int next_prelexed = 0;
+static bool prelex_failed = false;
+static unsigned int prelex_error_line = 0;
+static unsigned int prelex_error_column = 0;
+static char prelex_error_message[BUFSIZ];
+
+// A part of the input (which starts and ends at line boundaries)
+// that is lexed by one thread
+typedef struct {
+    unsigned int start; // offset of its first char
+    unsigned int end; // offset just past its last char
+    compact_token *tokens; // the tokens lexed (that start in the chunk)
+    unsigned int num_tokens;
+    unsigned int capacity; // number of elements tokens has room for
+    bool failed; // was there a lexical error in the chunk?
+    unsigned int error_line;
+    unsigned int error_column;
+    char error_message[BUFSIZ];
+    jmp_buf on_error; // where to go on a lexical error
+} lex_chunk;
+
+// The chunk this thread is lexing (NULL when lexing serially)
+static _Thread_local lex_chunk *current_chunk = NULL;
 
 // Check the lexer's invariant
 static void lexer_okay()
 {
-    assert(done == (input_file == NULL));
-    assert(done == (filename == NULL));
+    // the input is kept after EOF, until lexer_close,
+    // so that tokens can still be expanded
+    assert(done || input != NULL);
+    assert((input == NULL) == (filename == NULL));
+    assert((input == NULL) == (line_starts == NULL));
+    assert(pos <= input_len);
 }
 
 // Initialize the lexer (i.e., its data structures)
 static void lexer_initialize()
 {
     filename = NULL;
-    input_file = NULL;
+    input = NULL;
+    input_len = 0;
+    pos = 0;
+    line_starts = NULL;
+    num_lines = 0;
     done = true;
-    line = 1;
-    column = 1;
+    for (unsigned int i = 0; i < num_comments; i++) {
+	free(comments[i].text);
+    }
+    free(comments);
+    comments = NULL;
+    num_comments = 0;
+    comments_capacity = 0;
+    num_ends = 0;
+    free(prelexed);
+    is_prelexed = false;
+    prelexed = NULL;
+    num_prelexed = 0;
+    next_prelexed = 0;
+    prelex_failed = false;
     reserved_initialize();
 }
 
+// Set whether the lexer records the comments it skips
+void lexer_set_comment_recording(bool on)
+{
+    recording_comments = on;
+}
+
+// Return the array of comments the lexer has recorded since it was opened
+// (in order), setting *num_comments to its length,
+// and stop recording them in that array.
+lexer_comment *lexer_take_comments(unsigned int *num)
+{
+    lexer_comment *ret = comments;
+    *num = num_comments;
+    comments = NULL;
+    num_comments = 0;
+    comments_capacity = 0;
+    return ret;
+}
+
+// Record the comment that starts at offset start
+// and ends just before offset end (leaving out any carriage return)
+static void lexer_record_comment(unsigned int start, unsigned int end)
+{
+    if (end > start && input[end-1] == '\r') {
+	end--;
+    }
+    if (num_comments == comments_capacity) {
+	comments_capacity = (comments_capacity == 0) ? 16 : 2 * comments_capacity;
+	comments = (lexer_comment *) realloc(comments,
+				comments_capacity * sizeof(lexer_comment));
+	if (comments == NULL) {
+	    bail_with_error("No space to record comments of %s", filename);
+	}
+    }
+    char *text = malloc(end - start + 1);
+    if (text == NULL) {
+	bail_with_error("No space to record comments of %s", filename);
+    }
+    memcpy(text, input + start, end - start);
+    text[end - start] = '\0';
+    comments[num_comments].loc = lexer_offset_location(start);
+    comments[num_comments].text = text;
+    comments[num_comments].ends_before = num_ends;
+    num_comments++;
+}
+
+// Requires: f is open for reading
+// Read all of f into a freshly allocated buffer,
+// returning it and setting *len to the number of chars read.
+static char *lexer_read_all(FILE *f, const char *fname, size_t *len)
+{
+    size_t cap = BUFSIZ;
+    size_t n = 0;
+    char *buf = malloc(cap);
+    if (buf == NULL) {
+	bail_with_error("Cannot allocate space to read %s", fname);
+    }
+    size_t got;
+    while ((got = fread(buf + n, 1, cap - n, f)) > 0) {
+	n += got;
+	if (n == cap) {
+	    cap *= 2;
+	    buf = realloc(buf, cap);
+	    if (buf == NULL) {
+		bail_with_error("Cannot allocate space to read %s", fname);
+	    }
+	}
+    }
+    if (ferror(f)) {
+	bail_with_error("Cannot read %s", fname);
+    }
+    *len = n;
+    return buf;
+}
+
+// Requires: input holds input_len chars
+// Fill in line_starts and num_lines for the input,
+// finding each newline with memchr
+static void lexer_index_lines()
+{
+    unsigned int cap = 1 + input_len / 32;
+    line_starts = (unsigned int *) malloc(cap * sizeof(unsigned int));
+    if (line_starts == NULL) {
+	bail_with_error("Cannot allocate space for the line index of %s", filename);
+    }
+    line_starts[0] = 0;
+    num_lines = 1;
+    const char *end = input + input_len;
+    const char *nl = input;
+    while ((nl = memchr(nl, '\n', end - nl)) != NULL) {
+	nl++;
+	if (num_lines == cap) {
+	    cap *= 2;
+	    line_starts = (unsigned int *) realloc(line_starts, cap * sizeof(unsigned int));
+	    if (line_starts == NULL) {
+		bail_with_error("Cannot allocate space for the line index of %s", filename);
+	    }
+	}
+	line_starts[num_lines++] = nl - input;
+    }
+}
+
+// Lex the whole input in parallel (defined below)
+static void lexer_prelex();
+
+// Requires: input holds input_len chars and offset <= input_len
+// Start lexing the input, whose name (for messages) is display_name,
+// at the given offset
+static void lexer_start(const char *display_name, size_t offset)
+{
+    if (input_len > UINT_MAX) {
+	bail_with_error("File %s is too large!", display_name);
+    }
+    filename = display_name;
+    lexer_index_lines();
+    done = false;
+    pos = offset;
+    if (offset == 0 && lex_threads > 1 && input_len >= PARALLEL_LEX_MIN_SIZE
+	&& !recording_comments) {
+	lexer_prelex();
+    }
+    lexer_okay();
+}
+
 // Requires: fname != NULL
-// Requires: fname is the name of a readable file
-// Initialize the lexer and start it reading
-// from the given file name
-void lexer_open(const char *fname)
+// Requires: fname is the name of a readable file, or "-"
+// Return all of the file named fname (or the standard input, if fname is "-")
+// in a freshly allocated buffer, setting *len to the number of chars read
+char *lexer_read_file(const char *fname, size_t *len)
 {
-    lexer_initialize();
-    input_file = fopen(fname, "r");
+    if (strcmp(fname, "-") == 0) {
+	return lexer_read_all(stdin, LEXER_STDIN_NAME, len);
+    }
+    FILE *input_file = fopen(fname, "r");
     if (input_file == NULL) {
 	bail_with_error("Cannot open %s", fname);
     }
-    filename = fname;
-    done = feof(input_file);
-    if (done) {
-	input_file = NULL;
-	filename = NULL;
+    char *buf = lexer_read_all(input_file, fname, len);
+    if (fclose(input_file) == EOF) {
+	bail_with_error("Cannot close %s!", fname);
     }
-    lexer_okay();
+    return buf;
+}
+
+// Requires: fname != NULL
+// Requires: fname is the name of a readable file, or "-"
+// Initialize the lexer and start it reading
+// from the given file name (or the standard input, if fname is "-")
+void lexer_open(const char *fname)
+{
+    lexer_initialize();
+    input = lexer_read_file(fname, &input_len);
+    input_owned = true;
+    lexer_start(strcmp(fname, "-") == 0 ? LEXER_STDIN_NAME : fname, 0);
+}
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until lexer_close is called
+// Initialize the lexer and start it reading from buf,
+// using display_name as the file name in tokens and messages
+void lexer_open_buffer(const char *buf, size_t len, const char *display_name)
+{
+    lexer_open_buffer_at(buf, len, display_name, 0);
+}
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until lexer_close is called
+// Requires: offset <= len, and offset is where a token (or the
+//           space before one) starts, not in the middle of one or a comment
+// Initialize the lexer and start it reading from buf at the given offset,
+// using display_name as the file name in tokens and messages
+// (the chars before offset are only used to find line numbers)
+void lexer_open_buffer_at(const char *buf, size_t len,
+			  const char *display_name, size_t offset)
+{
+    lexer_initialize();
+    input = buf;
+    input_len = len;
+    input_owned = false;
+    lexer_start(display_name, offset);
+}
+
+// Set the number of threads used to lex large files
+// (all of whose tokens are then lexed when the file is opened)
+void lexer_set_threads(unsigned int num_threads)
+{
+    lex_threads = (num_threads == 0) ? 1 : num_threads;
 }
 
 // Close the file the lexer is working on
@@ -63,13 +317,21 @@ void lexer_open(const char *fname)
 void lexer_close()
 {
     lexer_okay();
-    if (input_file != NULL) {
-	int rc = fclose(input_file);
-	if (rc == EOF) {
-	    bail_with_error("Cannot close %s!", filename);
-	}
+    if (input_owned) {
+	free((char *) input);
     }
-    input_file = NULL;
+    input_owned = false;
+    free(line_starts);
+    free(prelexed);
+    is_prelexed = false;
+    prelexed = NULL;
+    num_prelexed = 0;
+    next_prelexed = 0;
+    input = NULL;
+    input_len = 0;
+    pos = 0;
+    line_starts = NULL;
+    num_lines = 0;
     filename = NULL;
     done = true;
     lexer_okay();
@@ -82,66 +344,117 @@ bool lexer_done()
     return done;
 }
 
-// the previous value of column,
-// for use in lexer_ungetchar
-static unsigned int last_column = 0;
-
-// Requires: input_file is readable
-// Return the next char in the input
-// updating line and column as appropriate
-// update last_column to the old value of column
+// Return the next char in the input (or EOF at its end)
 static char lexer_getchar()
 {
-    char c = getc(input_file);
-    last_column = column;
-    if (c == '\n') {
-	line++;
-	column=1;
-    } else {
-	column++;
-    }
-    return c;
+    return (pos < input_len) ? input[pos++] : EOF;
 }
 
-// Requires: input_file is readable
-// Put c back into the input file stream
-// to be read again
+// Requires: c was the last char returned by lexer_getchar
+// Put c back into the input to be read again
 static void lexer_ungetchar(char c)
 {
-    column = last_column;
-    if (c == '\n') {
-	line--;
-    }
     if (c != EOF) {
-	ungetc(c, input_file);
+	pos--;
     }
 }
 
+// Return the 1-based line number of the given offset in the input,
+// found by binary search in line_starts
+static unsigned int lexer_offset_line(unsigned int offset)
+{
+    // invariant: line_starts[lo] <= offset < line_starts[hi] (or hi == num_lines)
+    unsigned int lo = 0;
+    unsigned int hi = num_lines;
+    while (hi - lo > 1) {
+	unsigned int mid = lo + (hi - lo) / 2;
+	if (line_starts[mid] <= offset) {
+	    lo = mid;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo + 1;
+}
+
+// Return the 1-based column number of the given offset in the input
+static unsigned int lexer_offset_column(unsigned int offset)
+{
+    return offset - line_starts[lexer_offset_line(offset) - 1] + 1;
+}
+
+// Requires: the lexer is open (even if done)
+//           and offset is at most the length of the input
+// Return the file location (file name, line, and column)
+// of the given offset in the input
+file_location lexer_offset_location(unsigned int offset)
+{
+    file_location ret;
+    ret.filename = filename;
+    ret.line = lexer_offset_line(offset);
+    ret.column = offset - line_starts[ret.line - 1] + 1;
+    return ret;
+}
+
+// Return the offset of the char last returned by lexer_getchar,
+// where EOF is at the offset just past the end of the input
+static unsigned int lexer_last_offset(char c)
+{
+    return (c == EOF) ? pos : pos - 1;
+}
+
+// Report a lexical error at the given offset in the input,
+// with a message formatted from fmt and the following arguments.
+// This does not return: when lexing serially, it prints the message
+// and exits; in a thread lexing a chunk, it records the error in the chunk
+// and jumps back to where the chunk was being lexed.
+static void lexer_error(unsigned int offset, const char *fmt, ...)
+{
+    char msg[BUFSIZ];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    unsigned int line = lexer_offset_line(offset);
+    unsigned int column = lexer_offset_column(offset);
+    if (current_chunk != NULL) {
+	current_chunk->failed = true;
+	current_chunk->error_line = line;
+	current_chunk->error_column = column;
+	memcpy(current_chunk->error_message, msg, sizeof(msg));
+	longjmp(current_chunk->on_error, 1);
+    }
+    lexical_error(filename, line, column, "%s", msg);
+}
+
 // forward declarations of lexical functions
 static void lexer_consume_ignored();
-static token lexer_ident(char c, token t);
-static token lexer_number(char c, token t);
-static token lexer_becomes(char c, token t);
-static token lexer_starts_less(char c, token t);
-static token lexer_starts_greater(char c, token t);
+static compact_token lexer_ident(compact_token t);
+static compact_token lexer_number(compact_token t);
+static compact_token lexer_becomes(compact_token t);
+static compact_token lexer_starts_less(compact_token t);
+static compact_token lexer_starts_greater(compact_token t);
+static compact_token lexer_next_prelexed();
 
 // Requires: !lexer_done()
-// Return the next token in the input file,
+// Return the next token in the input file, in compact form,
 // advancing in the input
-token lexer_next()
+compact_token lexer_next_compact()
 {
-    token t;
-    t.filename = filename;
+    if (is_prelexed) {
+	return lexer_next_prelexed();
+    }
+
+    compact_token t;
     t.typ = eofsym;
-    t.text = NULL;
     t.value = 0;
+    t.length = 0;
 
     lexer_consume_ignored();
 
-    t.line = line;
-    t.column = column;
+    t.offset = pos;
 
-    char c = lexer_getchar(input_file);
+    char c = lexer_getchar();
     
     // since we consumed all the whitespace
     // c should not be a kind of space character
@@ -149,24 +462,15 @@ token lexer_next()
     
     if (c == EOF) {
 	t.typ = eofsym;
-	t.text = NULL;
-	filename = NULL;
-	input_file = NULL;
 	done = true;
 	return t;
     }
+    t.length = 1;
     if (isalpha(c)) {
-	return lexer_ident(c, t);
+	return lexer_ident(t);
     } else if (isdigit(c)) {
-	return lexer_number(c, t);
+	return lexer_number(t);
     } else {
-	// leave room in t.text for 2 chars of text
-	t.text = malloc(3 * sizeof(char));
-	if (t.text == NULL) {
-	    bail_with_error("Cannot allocate space for token text!");
-	}
-	t.text[0] = c;
-	t.text[1] = '\0';
 	switch (c) {
 	case '.':
 	    t.typ = periodsym;
@@ -178,7 +482,7 @@ token lexer_next()
 	    t.typ = commasym;
 	    break;
 	case ':':
-	    return lexer_becomes(c, t);
+	    return lexer_becomes(t);
 	case '=':
 	    t.typ = eqsym;
 	    break;
@@ -189,10 +493,10 @@ token lexer_next()
 	    t.typ = rparensym;
 	    break;
 	case '<':
-	    return lexer_starts_less(c, t);
+	    return lexer_starts_less(t);
 	    break;
 	case '>':
-	    return lexer_starts_greater(c, t);
+	    return lexer_starts_greater(t);
 	    break;
 	case '+':
 	    t.typ = plussym;
@@ -207,15 +511,230 @@ token lexer_next()
 	    t.typ = divsym;
 	    break;
 	default:
-	    lexical_error(filename, line, column-1,
-			  "Illegal character '%c' (0%o)",
-			   c, c);
+	    lexer_error(t.offset, "Illegal character '%c' (0%o)", c, c);
 	    break;
 	}
 	return t;
     }
 }
 
+// Requires: is_prelexed && !lexer_done()
+// Return the next of the tokens lexed in parallel,
+// or report the lexical error that stopped the lexing
+// if they have all been returned
+static compact_token lexer_next_prelexed()
+{
+    if (next_prelexed == num_prelexed) {
+	// only happens if there was an error, as the last token is eofsym
+	pos = input_len;
+	done = true;
+	lexical_error(filename, prelex_error_line, prelex_error_column,
+		      "%s", prelex_error_message);
+    }
+    compact_token t = prelexed[next_prelexed++];
+    pos = t.offset + t.length;
+    if (t.typ == eofsym) {
+	done = true;
+    }
+    return t;
+}
+
+// If the input was lexed in parallel when it was opened,
+// without a lexical error, set *tokens to the array of all its tokens
+// (ending with the eofsym token) and *num_tokens to its length,
+// and return true; otherwise return false.
+bool lexer_prelexed_tokens(const compact_token **tokens,
+			   unsigned int *num_tokens)
+{
+    if (!is_prelexed || prelex_failed) {
+	return false;
+    }
+    *tokens = prelexed;
+    *num_tokens = num_prelexed;
+    return true;
+}
+
+// Requires: lexer_prelexed_tokens would return true
+// Return the index of the token lexer_next_compact will return next
+unsigned int lexer_prelexed_position()
+{
+    return next_prelexed;
+}
+
+// Requires: lexer_prelexed_tokens would return true
+//           and index < the number of tokens
+// Make the next token that lexer_next_compact returns be
+// the one at the given index
+void lexer_prelexed_seek(unsigned int index)
+{
+    assert(is_prelexed && index < num_prelexed);
+    next_prelexed = index;
+    done = false;
+}
+
+// Add t to the end of the tokens lexed in chunk c
+static void lex_chunk_add(lex_chunk *c, compact_token t)
+{
+    if (c->num_tokens == c->capacity) {
+	c->capacity = (c->capacity == 0) ? 1024 : 2 * c->capacity;
+	c->tokens = (compact_token *) realloc(c->tokens,
+					      c->capacity * sizeof(compact_token));
+	if (c->tokens == NULL) {
+	    bail_with_error("No space to lex %s", filename);
+	}
+    }
+    c->tokens[c->num_tokens++] = t;
+}
+
+// Lex the tokens that start in the chunk given by arg,
+// stopping at the first lexical error (which is recorded in the chunk)
+static void *lex_chunk_worker(void *arg)
+{
+    lex_chunk *c = (lex_chunk *) arg;
+    current_chunk = c;
+    pos = c->start;
+    if (setjmp(c->on_error) == 0) {
+	for (;;) {
+	    // skipping spaces and comments may go past the chunk's end,
+	    // but no token spans lines, so none is split between chunks
+	    lexer_consume_ignored();
+	    if (pos >= c->end || pos >= input_len) {
+		break;
+	    }
+	    lex_chunk_add(c, lexer_next_compact());
+	}
+    }
+    current_chunk = NULL;
+    return NULL;
+}
+
+// Lex the whole input with lex_threads threads, each lexing a chunk
+// of about the same size that is split at a newline,
+// and put the tokens in prelexed, in order.
+// If a chunk has a lexical error, the tokens after the error are dropped
+// and the error is reported when the lexer reaches it,
+// just as if the file were lexed serially.
+static void lexer_prelex()
+{
+    unsigned int n = lex_threads;
+    lex_chunk *chunks = (lex_chunk *) malloc(n * sizeof(lex_chunk));
+    pthread_t *threads = (pthread_t *) malloc(n * sizeof(pthread_t));
+    if (chunks == NULL || threads == NULL) {
+	bail_with_error("No space to lex %s", filename);
+    }
+
+    unsigned int start = 0;
+    for (unsigned int i = 0; i < n; i++) {
+	unsigned int end = (unsigned int) input_len;
+	if (i+1 < n) {
+	    size_t target = input_len * (i+1) / n;
+	    if (target < start) {
+		target = start;
+	    }
+	    const char *nl = memchr(input + target, '\n', input_len - target);
+	    if (nl != NULL) {
+		end = (unsigned int) (nl - input) + 1;
+	    }
+	}
+	chunks[i].start = start;
+	chunks[i].end = end;
+	chunks[i].tokens = NULL;
+	chunks[i].num_tokens = 0;
+	chunks[i].capacity = 0;
+	chunks[i].failed = false;
+	start = end;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+	if (pthread_create(&threads[i], NULL, lex_chunk_worker, &chunks[i]) != 0) {
+	    bail_with_error("Unable to start a thread to lex %s", filename);
+	}
+    }
+
+    // count the tokens up to the first error, if any (and the eofsym token)
+    unsigned int total = 1;
+    bool failed = false;
+    for (unsigned int i = 0; i < n; i++) {
+	pthread_join(threads[i], NULL);
+	if (!failed) {
+	    total += chunks[i].num_tokens;
+	    failed = chunks[i].failed;
+	}
+    }
+
+    prelexed = (compact_token *) malloc(total * sizeof(compact_token));
+    if (prelexed == NULL) {
+	bail_with_error("No space to lex %s", filename);
+    }
+    num_prelexed = 0;
+    for (unsigned int i = 0; i < n && !prelex_failed; i++) {
+	if (chunks[i].num_tokens > 0) {
+	    memcpy(prelexed + num_prelexed, chunks[i].tokens,
+		   chunks[i].num_tokens * sizeof(compact_token));
+	    num_prelexed += chunks[i].num_tokens;
+	}
+	if (chunks[i].failed) {
+	    prelex_failed = true;
+	    prelex_error_line = chunks[i].error_line;
+	    prelex_error_column = chunks[i].error_column;
+	    memcpy(prelex_error_message, chunks[i].error_message,
+		   sizeof(prelex_error_message));
+	}
+    }
+    if (!prelex_failed) {
+	compact_token eof;
+	eof.offset = (unsigned int) input_len;
+	eof.length = 0;
+	eof.value = 0;
+	eof.typ = eofsym;
+	prelexed[num_prelexed++] = eof;
+    }
+    next_prelexed = 0;
+    is_prelexed = true;
+
+    for (unsigned int i = 0; i < n; i++) {
+	free(chunks[i].tokens);
+    }
+    free(chunks);
+    free(threads);
+}
+
+// Requires: t was returned by lexer_next_compact
+//           and lexer_close has not been called since
+// Return the full form of the token t, with its file name,
+// line, column, and text.
+// Only identifiers and numbers have their text allocated;
+// other tokens share the fixed text of their token type.
+token lexer_expand(compact_token t)
+{
+    token ret;
+    ret.typ = t.typ;
+    ret.filename = filename;
+    ret.line = lexer_offset_line(t.offset);
+    ret.column = t.offset - line_starts[ret.line - 1] + 1;
+    ret.value = t.value;
+    if (t.typ == identsym || t.typ == numbersym) {
+	char *text = alloc_list_malloc((t.length+1)*sizeof(char));
+	if (text == NULL) {
+	    bail_with_error("Cannot allocate space for token text!");
+	}
+	memcpy(text, input + t.offset, t.length);
+	text[t.length] = '\0';
+	ret.text = text;
+    } else {
+	ret.text = ttyp2text(t.typ);
+    }
+    return ret;
+}
+
+// Requires: !lexer_done()
+// Return the next token in the input file,
+// advancing in the input
+token lexer_next()
+{
+    return lexer_expand(lexer_next_compact());
+}
+
 // Requires: !lexer_done()
 // Return the name of the current file
 const char *lexer_filename()
@@ -233,7 +752,7 @@ unsigned int lexer_line()
     if (lexer_done()) {
 	bail_with_error("Asking for line of done lexer!");
     }
-    return line;
+    return lexer_offset_line(pos);
 }
 
 // Requires: !lexer_done()
@@ -243,140 +762,123 @@ unsigned int lexer_column()
     if (lexer_done()) {
 	bail_with_error("Asking for column of done lexer!");
     }
-    return column;
+    return lexer_offset_column(pos);
 }
 
-// Requires: input_file is readable
-// Advance input_file to the next newline
+// Advance past the rest of a comment, through the next newline.
+// The newline is found with memchr, which scans many chars at a time,
+// since comments run to the end of the line no matter what they contain.
 static void lexer_consume_comment()
 {
-    char c = lexer_getchar();
-    while (c != '\n' && c != EOF) {
-	c = lexer_getchar();
-    }
-    if (c == EOF) {
-	lexical_error(filename, line, column-1,
-		      "File ended while reading comment!");
+    const char *nl = memchr(input + pos, '\n', input_len - pos);
+    if (nl == NULL) {
+	pos = input_len;
+	lexer_error(pos, "File ended while reading comment!");
     }
-    // assert(c == '\n');
+    pos = (nl - input) + 1;
 }
 
-// Requires: input_file is readable
-// Advance in the input file until
+// Advance in the input until
 // the next char is the start of a token
 // that is not ignored
-// (i.e., not whitespace or a comment)
+// (i.e., not whitespace or a comment).
+// This works directly on the input buffer;
+// since lines and columns are found from offsets when needed,
+// there is no position bookkeeping to do here.
 static void lexer_consume_ignored()
 {
-    char c = lexer_getchar();
-    while (isspace(c) || c == '#') {
-	if (isspace(c)) {
-	    // ignore the whitespace char
-	    c = lexer_getchar();
+    while (pos < input_len) {
+	unsigned char c = input[pos];
+	if (c == ' ' || isspace(c)) {
+	    pos++;
 	} else if (c == '#') {
+	    unsigned int start = pos;
+	    pos++;
 	    lexer_consume_comment();
-	    c = lexer_getchar();
+	    if (recording_comments) {
+		lexer_record_comment(start, pos - 1);
+	    }
+	} else {
+	    break;
 	}
     }
-    // assert(!isspace(c) && c != '#');
-    lexer_ungetchar(c);
+    // assert(pos == input_len || !isspace(input[pos]) && input[pos] != '#');
 }
 
-// Requires: c is a letter
+// Requires: t.offset is the offset of a letter
 // Return a token for a reserved word
 // or an identifier
-static token lexer_ident(char c, token t)
+static compact_token lexer_ident(compact_token t)
 {
-    char *text = malloc((MAX_IDENT_LENGTH+1)*sizeof(char));
-    if (text == NULL) {
-	bail_with_error("Cannot allocate space for identifier");
-    }
-    text[0] = c;
-    int n = 1;
-    c = lexer_getchar();
+    unsigned int n = 1;
+    char c = lexer_getchar();
     while (isalpha(c) || isdigit(c)) {
 	if (n >= MAX_IDENT_LENGTH) {
-	    text[n] = '\0';
-	    lexical_error(filename, t.line, t.column,
-			  "Identifier starting \"%s\" is too long!",
-			  text);
+	    lexer_error(t.offset, "Identifier starting \"%.*s\" is too long!",
+			(int) n, input + t.offset);
 	}
-	text[n] = c;
 	n++;
 	c = lexer_getchar();
     }
     // assert(!isalpha(c) && !isdigit(c));
-    text[n+1] = '\0';    
     lexer_ungetchar(c);
-    t.text = text;
-    t.typ = reserved_type(text);
+    t.length = n;
+    t.typ = reserved_lookup(input + t.offset, n);
+    if (t.typ == endsym && recording_comments) {
+	num_ends++;
+    }
     return t;
 }
 
 #define MAX_NUM_LENGTH 5
 
-// Requires: c is a digit
+// Requires: t.offset is the offset of a digit
 // Return a token for a number
-static token lexer_number(char c, token t)
+static compact_token lexer_number(compact_token t)
 {
-    char *text = malloc((MAX_NUM_LENGTH+1)*sizeof(char));
-    if (text == NULL) {
-	bail_with_error("Cannot allocate space for number");
-    }
-    text[0] = c;
-    int n = 1;
-    c = lexer_getchar();
+    int val = input[t.offset] - '0';
+    unsigned int n = 1;
+    char c = lexer_getchar();
     while (isdigit(c)) {
 	if (n >= MAX_NUM_LENGTH) {
-	    text[n] = '\0';
-	    bail_with_error(filename, t.line, t.column,
-			    "Number starting \"%s\" is too long!",
-			    text);
+	    lexer_error(t.offset, "Number starting \"%.*s\" is too long!",
+			(int) n, input + t.offset);
 	}
-	text[n] = c;
+	val = 10 * val + (c - '0');
 	n++;
 	c = lexer_getchar();
     }
-    text[n+1] = '\0';
     lexer_ungetchar(c);
-    t.text = text;
-    int val;
-    sscanf(text, "%d", &val);
+    t.length = n;
     if (val > SHRT_MAX) {
-	lexical_error(filename, t.line, t.column,
-		      "The value of %s is too large for a short!",
-		      text);
+	lexer_error(t.offset, "The value of %.*s is too large for a short!",
+		    (int) n, input + t.offset);
     }
     t.value = val;
     t.typ = numbersym;
     return t;
 }
 
-// Requires: c is a colon character (:)
+// Requires: t.offset is the offset of a colon character (:)
 // Returns the token for a becomessym
-static token lexer_becomes(char c, token t)
+static compact_token lexer_becomes(compact_token t)
 {
-    assert(c == ':');
-    c = lexer_getchar();
+    char c = lexer_getchar();
     if (c != '=') {
-	lexical_error(filename, line, column-1,
-		      "Expecting '=' after a colon, not '%c'",
-		      c);
+	lexer_error(lexer_last_offset(c), "Expecting '=' after a colon, not '%c'",
+		    c);
     }
-    t.text[1] = c;
-    t.text[2] = '\0';
+    t.length = 2;
     t.typ = becomessym;
     return t;
 }
 
-// Requires: c is a less-than character (<)
+// Requires: t.offset is the offset of a less-than character (<)
 // Returns the token appropriate for the next char
-static token lexer_starts_less(char c, token t)
+static compact_token lexer_starts_less(compact_token t)
 {
-    assert(c == '<');
-    c = lexer_getchar();
-    t.text[1] = c;
-    t.text[2] = '\0';
+    char c = lexer_getchar();
+    t.length = 2;
     switch (c) {
     case '=':
 	t.typ = leqsym;
@@ -385,7 +887,7 @@ static token lexer_starts_less(char c, token t)
 	t.typ = neqsym;
 	break;
     default:
-	t.text[1] = '\0';
+	t.length = 1;
 	lexer_ungetchar(c);
 	t.typ = lessym;
 	break;
@@ -393,22 +895,21 @@ static token lexer_starts_less(char c, token t)
     return t;
 }
 
-static token lexer_starts_greater(char c, token t)
+// Requires: t.offset is the offset of a greater-than character (>)
+// Returns the token appropriate for the next char
+static compact_token lexer_starts_greater(compact_token t)
 {
-    assert(c == '>');
-    c = lexer_getchar();
-    t.text[1] = c;
-    t.text[2] = '\0';
+    char c = lexer_getchar();
+    t.length = 2;
     switch (c) {
     case '=':
 	t.typ = geqsym;
 	break;
     default:
-	t.text[1] = '\0';
+	t.length = 1;
 	lexer_ungetchar(c);
 	t.typ = gtrsym;
 	break;
     }
     return t;
-
 }
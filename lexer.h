@@ -2,14 +2,66 @@
 #ifndef _LEXER_H
 #define _LEXER_H
 #include <stdbool.h>
+#include <stddef.h>
 #include "token.h"
+#include "file_location.h"
+
+// A comment in the input, which the lexer otherwise skips
+typedef struct {
+    file_location loc; // of the comment's #
+    char *text; // from the # up to (but not including) the newline
+    unsigned int ends_before; // the number of end tokens before it
+} lexer_comment;
+
+// Set whether the lexer records the comments it skips
+// (for lexer_take_comments); this is off unless set.
+extern void lexer_set_comment_recording(bool on);
+
+// Return the array of comments the lexer has recorded since it was opened
+// (in order), setting *num_comments to its length,
+// and stop recording them in that array.
+// The caller owns the array and the comments' texts.
+extern lexer_comment *lexer_take_comments(unsigned int *num_comments);
+
+// Set the number of threads used to lex large files (the default is 1).
+// With more than one, a large file is split into chunks at newlines
+// when it is opened, and the chunks are lexed in parallel;
+// the tokens (and any lexical error) are the same as when lexing serially.
+// (Files are always lexed serially while comments are being recorded.)
+extern void lexer_set_threads(unsigned int num_threads);
+
+// The name used in tokens and messages for the standard input
+#define LEXER_STDIN_NAME "<stdin>"
 
 // Requires: fname != NULL
-// Requires: fname is the name of a readable file
+// Requires: fname is the name of a readable file, or "-"
 // Initialize the lexer and start it reading
-// from the given file name
+// from the given file name (or the standard input, if fname is "-")
 extern void lexer_open(const char *fname);
 
+// Requires: fname != NULL
+// Requires: fname is the name of a readable file, or "-"
+// Return all of the file named fname (or the standard input, if fname is "-")
+// in a freshly allocated buffer, setting *len to the number of chars read
+extern char *lexer_read_file(const char *fname, size_t *len);
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until lexer_close is called
+// Initialize the lexer and start it reading from buf,
+// using display_name as the file name in tokens and messages
+extern void lexer_open_buffer(const char *buf, size_t len,
+			      const char *display_name);
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until lexer_close is called
+// Requires: offset <= len, and offset is where a token (or the
+//           space before one) starts, not in the middle of one or a comment
+// Initialize the lexer and start it reading from buf at the given offset,
+// using display_name as the file name in tokens and messages
+// (the chars before offset are only used to find line numbers)
+extern void lexer_open_buffer_at(const char *buf, size_t len,
+				 const char *display_name, size_t offset);
+
 // Close the file the lexer is working on
 // and make this lexer be done
 extern void lexer_close();
@@ -23,6 +75,40 @@ extern bool lexer_done();
 // advancing in the input
 extern token lexer_next();
 
+// Requires: !lexer_done()
+// Return the next token in the input file, in compact form,
+// advancing in the input
+extern compact_token lexer_next_compact();
+
+// If the input was lexed in parallel when it was opened,
+// without a lexical error, set *tokens to the array of all its tokens
+// (ending with the eofsym token) and *num_tokens to its length,
+// and return true; otherwise return false.
+extern bool lexer_prelexed_tokens(const compact_token **tokens,
+				  unsigned int *num_tokens);
+
+// Requires: lexer_prelexed_tokens would return true
+// Return the index of the token lexer_next_compact will return next
+extern unsigned int lexer_prelexed_position();
+
+// Requires: lexer_prelexed_tokens would return true
+//           and index < the number of tokens
+// Make the next token that lexer_next_compact returns be
+// the one at the given index
+extern void lexer_prelexed_seek(unsigned int index);
+
+// Requires: t was returned by lexer_next_compact
+//           and lexer_close has not been called since
+// Return the full form of the token t, with its file name,
+// line, column, and text.
+extern token lexer_expand(compact_token t);
+
+// Requires: the lexer is open (even if done)
+//           and offset is at most the length of the input
+// Return the file location (file name, line, and column)
+// of the given offset in the input
+extern file_location lexer_offset_location(unsigned int offset);
+
 // Requires: !lexer_done()
 // Return the name of the current file
 extern const char *lexer_filename();
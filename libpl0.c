@@ -0,0 +1,226 @@
+// compile PL/0 programs in memory, for programs that use the compiler
+// as a library (see libpl0.h)
+// for clock_gettime and strdup
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libpl0.h"
+#include "alloc_list.h"
+#include "lexer.h"
+#include "parser.h"
+#include "reparse.h"
+#include "unparser.h"
+#include "scope_check.h"
+#include "scope_symtab.h"
+#include "utilities.h"
+
+// Set the number of threads that compilations may use
+void pl0_set_threads(unsigned int num_threads)
+{
+    lexer_set_threads(num_threads);
+    parser_set_threads(num_threads);
+    unparser_set_threads(num_threads);
+    scope_check_set_threads(num_threads);
+}
+
+// Return the number of seconds from start to end
+static double seconds_between(struct timespec start, struct timespec end)
+{
+    return (double) (end.tv_sec - start.tv_sec)
+	+ (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Record the error caught by catcher as the diagnostic of result
+static void record_diagnostic(pl0_result *result, error_catcher *catcher)
+{
+    pl0_diagnostic *diag = malloc(sizeof(pl0_diagnostic));
+    char *message = strdup(catcher->message);
+    if (diag == NULL || message == NULL) {
+	free(diag);
+	free(message);
+	return;
+    }
+    diag->kind = catcher->kind;
+    diag->loc = catcher->loc;
+    diag->message = message;
+    result->diagnostics = diag;
+    result->num_diagnostics = 1;
+}
+
+// Copy the current scope's symbol table into result
+static void record_symbols(pl0_result *result)
+{
+    unsigned int n = scope_size();
+    if (n == 0) {
+	return;
+    }
+    pl0_symbol *symbols = malloc(n * sizeof(pl0_symbol));
+    if (symbols == NULL) {
+	return;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+	id_attrs *attrs = scope_attrs_at(i);
+	symbols[i].name = scope_name_at(i);
+	symbols[i].kind = attrs->kind;
+	symbols[i].offset = attrs->offset;
+	symbols[i].loc = attrs->file_loc;
+    }
+    result->symbols = symbols;
+    result->num_symbols = n;
+}
+
+// Parse and scope check the PL/0 program in buf,
+// using name as its file name, and return what was found
+// (or NULL if there is no space for the result)
+pl0_result *pl0_compile(const char *buf, size_t len, const char *name)
+{
+    pl0_result *result = calloc(1, sizeof(pl0_result));
+    if (result == NULL) {
+	return NULL;
+    }
+    result->name = strdup(name);
+    if (result->name == NULL) {
+	free(result);
+	return NULL;
+    }
+
+    // what has been done when an error is caught
+    volatile bool opened = false;
+    volatile bool parsed = false;
+    volatile bool checking = false;
+    struct timespec start, parse_end, end;
+    error_catcher catcher;
+    // what the compilation allocates, which is freed at the end,
+    // except for the program's AST, which the result keeps
+    alloc_list allocs;
+
+    errno = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    parse_end = start;
+    alloc_list_init(&allocs);
+    set_alloc_list(&allocs);
+    set_error_catcher(&catcher);
+    if (setjmp(catcher.env) == 0) {
+	if (len > UINT_MAX) {
+	    bail_with_error("File %s is too large!", name);
+	}
+	opened = true;
+	parser_open_buffer(buf, len, result->name);
+	AST *prog = parseyParse();
+	ast_keep(prog);
+	result->ast = prog;
+	parser_close();
+	opened = false;
+	parsed = true;
+	clock_gettime(CLOCK_MONOTONIC, &parse_end);
+
+	scope_initialize();
+	checking = true;
+	scope_check_program(result->ast);
+    } else {
+	// the parse's partial ASTs are freed with the rest of allocs
+	set_error_catcher(NULL);
+	record_diagnostic(result, &catcher);
+	if (opened) {
+	    parser_close();
+	}
+    }
+    set_error_catcher(NULL);
+    set_alloc_list(NULL);
+    alloc_list_release(&allocs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!parsed) {
+	parse_end = end;
+    }
+
+    if (checking) {
+	record_symbols(result);
+	scope_finalize();
+    }
+    result->timings.parse_seconds = seconds_between(start, parse_end);
+    result->timings.check_seconds = seconds_between(parse_end, end);
+    result->timings.total_seconds = seconds_between(start, end);
+    return result;
+}
+
+// Compile buf, which holds old_text after an edit, reusing prev
+// (which must not be used afterwards) if only one statement changed
+pl0_result *pl0_recompile(pl0_result *prev, const char *old_text, size_t old_len,
+			  const char *buf, size_t len)
+{
+    if (prev->ast != NULL && prev->num_diagnostics == 0
+	&& old_len == len && memcmp(old_text, buf, len) == 0) {
+	return prev;
+    }
+
+    struct timespec start, parse_end, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // what parsing and checking allocate, as in pl0_compile
+    // (reparse_edit keeps the new statement out of it)
+    alloc_list allocs;
+    alloc_list_init(&allocs);
+    set_alloc_list(&allocs);
+    AST *stmt = NULL;
+    if (prev->ast != NULL && prev->num_diagnostics == 0 && len <= UINT_MAX) {
+	stmt = reparse_edit(prev->ast, old_text, old_len, buf, len, prev->name);
+    }
+    if (stmt == NULL) {
+	set_alloc_list(NULL);
+	alloc_list_release(&allocs);
+	pl0_result *result = pl0_compile(buf, len, prev->name);
+	pl0_result_free(prev);
+	return result;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &parse_end);
+
+    // the declarations have not changed, but the symbol table is built again
+    // to check the new statement
+    pl0_result *result = prev;
+    free(result->symbols);
+    result->symbols = NULL;
+    result->num_symbols = 0;
+    program_t *prog = &result->ast->data.program;
+    error_catcher catcher;
+    set_error_catcher(&catcher);
+    scope_initialize();
+    if (setjmp(catcher.env) == 0) {
+	scope_check_constDecls(prog->num_cds, prog->cds);
+	scope_check_varDecls(prog->num_vds, prog->vds);
+	scope_check_stmt(stmt);
+    } else {
+	set_error_catcher(NULL);
+	record_diagnostic(result, &catcher);
+    }
+    set_error_catcher(NULL);
+    set_alloc_list(NULL);
+    alloc_list_release(&allocs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    record_symbols(result);
+    scope_finalize();
+    result->timings.parse_seconds = seconds_between(start, parse_end);
+    result->timings.check_seconds = seconds_between(parse_end, end);
+    result->timings.total_seconds = seconds_between(start, end);
+    return result;
+}
+
+// Free result (if not NULL), along with its AST and everything else in it
+void pl0_result_free(pl0_result *result)
+{
+    if (result == NULL) {
+	return;
+    }
+    for (unsigned int i = 0; i < result->num_diagnostics; i++) {
+	free(result->diagnostics[i].message);
+    }
+    free(result->diagnostics);
+    free(result->symbols);
+    ast_free(result->ast);
+    free(result->name);
+    free(result);
+}
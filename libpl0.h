@@ -0,0 +1,84 @@
+#ifndef _LIBPL0_H
+#define _LIBPL0_H
+#include <stddef.h>
+#include "ast.h"
+#include "id_attrs.h"
+#include "file_location.h"
+#include "utilities.h"
+
+// The libpl0 library compiles PL/0 programs held in memory,
+// returning what it found instead of printing it and exiting,
+// so a program can compile many sources without running the compiler.
+// Its functions are not reentrant: only one compilation
+// may be in progress at a time.
+
+// A problem found in a program
+typedef struct {
+    error_kind kind;
+    // where the problem is (loc.filename is NULL for a fatal_err)
+    file_location loc;
+    // what the problem is, without the location or a newline
+    char *message;
+} pl0_diagnostic;
+
+// A declared identifier, as recorded in the symbol table
+typedef struct {
+    const char *name;
+    id_kind kind;
+    unsigned int offset;  // from the beginning of the scope
+    file_location loc;    // of its declaration
+} pl0_symbol;
+
+// How long the parts of a compilation took, in seconds
+typedef struct {
+    double parse_seconds;  // lexing and parsing
+    double check_seconds;  // building the symbol table and scope checking
+    double total_seconds;
+} pl0_timings;
+
+// What compiling a program found.
+// The compiler stops at the first error, so there is at most one diagnostic.
+// All the pointers in it are valid until it is freed by pl0_result_free.
+typedef struct {
+    // the program's AST, or NULL if it could not be parsed
+    AST *ast;
+    unsigned int num_diagnostics;
+    pl0_diagnostic *diagnostics;
+    // the symbol table (the declarations checked before any error)
+    unsigned int num_symbols;
+    pl0_symbol *symbols;
+    pl0_timings timings;
+    // the program's name, to which the file locations refer
+    char *name;
+} pl0_result;
+
+// Set the number of threads that compilations may use
+// for the work that can be split up (the default is 1)
+extern void pl0_set_threads(unsigned int num_threads);
+
+// Requires: buf != NULL, buf holds len chars, and name != NULL
+// Parse and scope check the PL/0 program in buf,
+// using name as its file name in file locations and messages,
+// and return what was found (to be freed with pl0_result_free),
+// or NULL if there is no space for the result
+extern pl0_result *pl0_compile(const char *buf, size_t len, const char *name);
+
+// Requires: prev != NULL, prev is the result of compiling the old_len chars
+//           in old_text (by pl0_compile or pl0_recompile),
+//           and buf != NULL holds len chars
+// Compile the PL/0 program in buf, which is old_text after an edit,
+// using prev's name as its file name, and return what was found.
+// If prev had no errors and the edit is inside one statement,
+// only that statement is parsed again and scope checked
+// (see reparse.h), and prev's AST is updated and returned in prev;
+// otherwise the whole program is compiled, and prev is freed.
+// Either way, prev must not be used after this is called.
+// Return NULL if there is no space for the result.
+extern pl0_result *pl0_recompile(pl0_result *prev,
+				 const char *old_text, size_t old_len,
+				 const char *buf, size_t len);
+
+// Free result (if not NULL), along with its AST and everything else in it
+extern void pl0_result_free(pl0_result *result);
+
+#endif
@@ -0,0 +1,117 @@
+// check the libpl0 library: compile each file named on the command line
+// through it and print what the compiler would print for that file,
+// so the output can be compared with the tests' expected outputs.
+// (This is not part of the compiler; see the check-lib target.)
+// With --edit OLD NEW, it instead compiles OLD's text (named NEW),
+// then recompiles it after it is edited into NEW's text (with
+// pl0_recompile), and prints what that finds (see check-incremental).
+// With --threads N first, compilations use N threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libpl0.h"
+#include "unparser.h"
+
+// Return the contents of the file named fname (malloc'd),
+// setting *len to their length, or exit if it cannot be read
+static char *read_file(const char *fname, size_t *len)
+{
+	FILE *f = fopen(fname, "r");
+	if (f == NULL)
+	{
+		perror(fname);
+		exit(EXIT_FAILURE);
+	}
+	size_t capacity = BUFSIZ;
+	char *buf = malloc(capacity);
+	size_t n;
+	*len = 0;
+	while (buf != NULL && (n = fread(buf + *len, 1, capacity - *len, f)) > 0)
+	{
+		*len += n;
+		if (*len == capacity)
+		{
+			capacity *= 2;
+			buf = realloc(buf, capacity);
+		}
+	}
+	if (buf == NULL || ferror(f))
+	{
+		fprintf(stderr, "Cannot read %s\n", fname);
+		exit(EXIT_FAILURE);
+	}
+	fclose(f);
+	return buf;
+}
+
+// Print what the compiler would print for result
+static void print_result(pl0_result *result)
+{
+	if (result->ast != NULL)
+		unparseProgram(stdout, result->ast);
+	fflush(stdout);
+	for (unsigned int d = 0; d < result->num_diagnostics; d++)
+	{
+		pl0_diagnostic diag = result->diagnostics[d];
+		if (diag.loc.filename != NULL)
+			fprintf(stderr, "%s: line %d, column %d: ",
+					diag.loc.filename, diag.loc.line, diag.loc.column);
+		fprintf(stderr, "%s\n", diag.message);
+	}
+	fflush(stderr);
+}
+
+// Compile the file named old_name as if it were named new_name,
+// then recompile it with the text of the file named new_name,
+// and print what that finds
+static int check_edit(const char *old_name, const char *new_name)
+{
+	size_t old_len, len;
+	char *old_text = read_file(old_name, &old_len);
+	char *text = read_file(new_name, &len);
+	pl0_result *result = pl0_compile(old_text, old_len, new_name);
+	if (result != NULL)
+		result = pl0_recompile(result, old_text, old_len, text, len);
+	if (result == NULL)
+	{
+		fprintf(stderr, "No space to compile %s\n", new_name);
+		return EXIT_FAILURE;
+	}
+	print_result(result);
+	pl0_result_free(result);
+	free(old_text);
+	free(text);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 3 && strcmp(argv[1], "--threads") == 0)
+	{
+		pl0_set_threads((unsigned int) atoi(argv[2]));
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc == 4 && strcmp(argv[1], "--edit") == 0)
+		return check_edit(argv[2], argv[3]);
+
+	for (int i = 1; i < argc; i++)
+	{
+		size_t len;
+		char *buf = read_file(argv[i], &len);
+		pl0_result *result = pl0_compile(buf, len, argv[i]);
+		if (result == NULL)
+		{
+			fprintf(stderr, "No space to compile %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		print_result(result);
+		pl0_result_free(result);
+		free(buf);
+	}
+	return EXIT_SUCCESS;
+}
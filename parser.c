@@ -1,34 +1,80 @@
 // By: Vincent Lazo, Christian Manuel
 // parse given file, checking for valid syntax against given grammar, returning an AST
 
+// for pthreads
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <setjmp.h>
+#include <pthread.h>
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
 #include <stdbool.h>
 
 #include "parser.h"
+#include "token_stream.h"
 #include "lexer.h"
 #include "token.h"
 #include "ast.h"
 #include "utilities.h"
+#include "alloc_list.h"
+#include "scope_check.h"
 
 #define STMTBEGINTOKS 7
 
 #define DEBUG 0
 
-static token currToken;
+// the parser's state is per thread, as statements may be parsed in parallel
+static _Thread_local token currToken;
 // static token tempToken;
 
+// whether to scope check while parsing (see parser_set_scope_checking)
+static bool check_scopes = false;
+
+// number of threads to parse long begin statements with
+static unsigned int parse_threads = 1;
+
+// begin statements with fewer statements than this are parsed serially
+#define PARALLEL_PARSE_MIN_STMTS 4096
+
+// When a thread is parsing a statement in parallel with others,
+// it takes its tokens from range_tokens (the array of all tokens),
+// where range_next is the index of the next one to take,
+// and range_end is the index of the token (a semicolon or end)
+// just after the statement, which is the last one it may take.
+// Any syntax error makes it jump to range_failed,
+// as the statement is then parsed again serially to report the error.
+static _Thread_local const compact_token *range_tokens = NULL;
+static _Thread_local unsigned int range_next = 0;
+static _Thread_local unsigned int range_end = 0;
+static _Thread_local jmp_buf range_failed;
+
 token_type can_begin_stmt[STMTBEGINTOKS] =
 {identsym, beginsym, ifsym, whilesym, readsym, writesym, skipsym};
 
 // go to next token
 void advance()
 {
-	if (!lexer_done())
-		currToken = lexer_next();
+	if (range_tokens != NULL)
+	{
+		if (range_next > range_end)
+			longjmp(range_failed, 1);
+		currToken = lexer_expand(range_tokens[range_next++]);
+		return;
+	}
+	currToken = token_stream_next();
+}
+
+// report that saw was seen when a token of one of the num_expected types
+// in expected was expected (but in a thread parsing in parallel,
+// just give up, since the error will be found again serially)
+static void parser_error_unexpected(token_type *expected,
+									unsigned int num_expected, token saw)
+{
+	if (range_tokens != NULL)
+		longjmp(range_failed, 1);
+	parse_error_unexpected(expected, num_expected, saw);
 }
 
 // check if currToken is the appropriate token type
@@ -41,21 +87,60 @@ void eat(token_type tt)
 	else 
 	{
 		token_type expected[1] = {tt};
-		parse_error_unexpected(expected, 1, currToken);
+		parser_error_unexpected(expected, 1, currToken);
     }
 }
 
-// call lexer open
+// open the token stream (and so the lexer)
 void parser_open(const char *filename)
 {
-	lexer_open(filename);
-	currToken = lexer_next();
+	token_stream_open(filename);
+	currToken = token_stream_next();
+}
+
+// open the token stream (and so the lexer) on the given buffer,
+// which must not change until parser_close is called
+void parser_open_buffer(const char *buf, size_t len, const char *display_name)
+{
+	parser_open_buffer_at(buf, len, display_name, 0);
+}
+
+// open the token stream (and so the lexer) on the given buffer,
+// starting at the given offset (see lexer_open_buffer_at)
+void parser_open_buffer_at(const char *buf, size_t len, const char *display_name,
+						   size_t offset)
+{
+	token_stream_open_buffer_at(buf, len, display_name, offset);
+	currToken = token_stream_next();
 }
 
-// call lexer close
+// close the token stream (and so the lexer)
 void parser_close()
 {
-	lexer_close();
+	token_stream_close();
+}
+
+// set whether parsing also does the scope checking
+void parser_set_scope_checking(bool on)
+{
+	check_scopes = on;
+}
+
+// set the number of threads used to parse long begin statements
+void parser_set_threads(unsigned int num_threads)
+{
+	parse_threads = (num_threads == 0) ? 1 : num_threads;
+}
+
+// when scope checking while parsing, ast has been checked already,
+// so free it and return NULL; otherwise return ast
+static AST *keep_unless_checked(AST *ast)
+{
+	if (!check_scopes)
+		return ast;
+
+	ast_free(ast);
+	return NULL;
 }
 
 // parse program to return AST
@@ -75,40 +160,38 @@ AST *parseyParse()
 // <block> ::= {<const-decls>} {<var-decls>} <stmt>
 AST *parseBlock()
 {
-	AST_list const_defs = parseConstDecls();
-	AST_list var_decls = parseVarDecls();
+	AST_array_builder const_defs, var_decls;
+
+	parseConstDecls(&const_defs);
+	parseVarDecls(&var_decls);
 	AST *stmt = parseStmts();
 
+	if (check_scopes)
+	{
+		// the symbol table now owns the declared names,
+		// so free just the declarations' ASTs and arrays
+		for (unsigned int i = 0; i < const_defs.count; i++)
+			alloc_list_free(const_defs.elems[i]);
+		for (unsigned int i = 0; i < var_decls.count; i++)
+			alloc_list_free(var_decls.elems[i]);
+		alloc_list_free(const_defs.elems);
+		alloc_list_free(var_decls.elems);
+		return NULL;
+	}
+
 	// gives AST's starting location (7.2.1 in pdf)
 	file_location floc;
 
 	// checks if there is an empty const decl or var decl list; if so, set file location to the
 	// first non-empty list
-	if (!ast_list_is_empty(const_defs) || !ast_list_is_empty(var_decls))
+	if (const_defs.count > 0)
 	{
-		if (!ast_list_is_empty(const_defs))
-		{
-			if (ast_list_first(const_defs)->type_tag == const_decl_ast)
-			{
-				floc = ast_list_first(const_defs)->file_loc;
-			}
-			else
-			{
-				bail_with_error("Bad AST for const declarations");
-			}
-		}
-		// must be an else if to act in sequence
-		else if (!ast_list_is_empty(var_decls))
-		{
-			if (ast_list_first(var_decls)->type_tag == var_decl_ast)
-			{
-				floc = ast_list_first(var_decls)->file_loc;
-			}
-			else
-			{
-				bail_with_error("Bad AST for var declarations");
-			}
-		}
+		floc = const_defs.elems[0]->file_loc;
+	}
+	// must be an else if to act in sequence
+	else if (var_decls.count > 0)
+	{
+		floc = var_decls.elems[0]->file_loc;
 	}
 	// if both lists are empty (i.e. there are no const/ var decls) set file loc to stmt
 	else
@@ -116,22 +199,12 @@ AST *parseBlock()
 		floc = stmt->file_loc;
 	}
 
-	return ast_program(floc.filename, floc.line, floc.column, const_defs, var_decls, stmt);
-}
+	unsigned int num_cds = const_defs.count;
+	unsigned int num_vds = var_decls.count;
+	AST **cds = ast_array_builder_finish(&const_defs);
+	AST **vds = ast_array_builder_finish(&var_decls);
 
-// adds newTail onto end of existing AST_list
-static void add_AST_to_end(AST_list *head, AST_list *tail, AST_list newTail)
-{
-	if (ast_list_is_empty(*head))
-	{
-		*head = newTail;
-		*tail = ast_list_last_elem(newTail);
-	}
-	else
-	{
-		ast_list_splice(*tail, newTail);
-		*tail = ast_list_last_elem(newTail);
-	}
+	return ast_program(floc.filename, floc.line, floc.column, num_cds, cds, num_vds, vds, stmt);
 }
 
 // -----------------------------const defs-----------------------------
@@ -139,34 +212,32 @@ static void add_AST_to_end(AST_list *head, AST_list *tail, AST_list newTail)
 // <const-decls> ::= {<const-decl>}
 // i.e. there can be 0 or more const decls
 // wrapper function for parseConstDecl
-AST_list parseConstDecls()
+// puts the const decls in cds
+void parseConstDecls(AST_array_builder *cds)
 {
-	AST_list ret = ast_list_empty_list();
-	AST_list last = ret;
 	token const_sym = currToken;
 
+	ast_array_builder_init(cds);
+
 	// checks if there even exists any const decls
 	while (currToken.typ == constsym)
 	{
 		eat(constsym);
-		add_AST_to_end(&ret, &last, ast_list_singleton(parseConstDecl(const_sym)));
+		parseConstDecl(const_sym, cds);
 		eat(semisym);
 	}
-
-	return ret;
 }
 
 // <const-decl> ::= const <ident> = <number>;
 // <idents> ::= <ident> {<comma-ident>}
 // 							  ^
 // 						, <ident>
-AST_list parseConstDecl(token const_sym)
+// adds the const decls to the end of decls
+void parseConstDecl(token const_sym, AST_array_builder *decls)
 {
-	AST_list ret, last, new_const_decl;
 	token idTemp;
 
-	ret = ast_list_singleton(parseConstIdent(const_sym));
-	last = ret;
+	ast_array_builder_add(decls, parseConstIdent(const_sym));
 
 	while (currToken.typ == commasym)
 	{
@@ -174,16 +245,12 @@ AST_list parseConstDecl(token const_sym)
 
 		idTemp = currToken;
 
-		new_const_decl = parseConstIdent(idTemp);
-		add_AST_to_end(&ret, &last, new_const_decl);
+		ast_array_builder_add(decls, parseConstIdent(idTemp));
 	}
-
-
-	return ret;
 }
 
 // go to next ident
-AST_list parseConstIdent(token idTemp)
+AST *parseConstIdent(token idTemp)
 {
 	token idToken = currToken;
 	token numToken;
@@ -196,43 +263,41 @@ AST_list parseConstIdent(token idTemp)
 
 	eat(numbersym);
 
-	return ast_list_singleton(ast_const_def(idTemp, idToken.text, numToken.value));
+	AST *ret = ast_const_def(idTemp, idToken.text, numToken.value);
+	if (check_scopes)
+		scope_check_constDecl(ret);
+
+	return ret;
 }
 
 // -----------------------------var decls-----------------------------
 
 // <var-decls> ::= {<var-decl>}
 // wrapper function for parseVarDecl
-AST_list parseVarDecls()
+// puts the var decls in vds
+void parseVarDecls(AST_array_builder *vds)
 {
-	AST_list ret = ast_list_empty_list();
-	AST_list last = ret;
-	//token var_sym = currToken;
-	// printf("in parseVarDecls()\n");
-	// if (currToken.typ == varsym)
+	ast_array_builder_init(vds);
 
 	// checks if there even exists any var decls
 	while (currToken.typ == varsym)
 	{
 		eat(varsym);
-		add_AST_to_end(&ret, &last, ast_list_singleton(parseVarDecl()));
+		parseVarDecl(vds);
 		eat(semisym);
 	}
-
-	return ret;
 }
 
 // <var-decl> ::= var <idents> ;
 // <idents> ::= <ident> {<comma-ident>}
 // 							  ^
 // 						, <ident>
-AST_list parseVarDecl()
+// adds the var decls to the end of decls
+void parseVarDecl(AST_array_builder *decls)
 {
-	AST_list ret, last, new_var_decl;
 	token idTemp = currToken;
 
-	ret = ast_list_singleton(parseVarIdent(idTemp));
-	last = ret;
+	ast_array_builder_add(decls, parseVarIdent(idTemp));
 
 	while (currToken.typ == commasym)
 	{
@@ -240,36 +305,42 @@ AST_list parseVarDecl()
 
 		idTemp = currToken;
 
-		new_var_decl = parseVarIdent(idTemp);
-		add_AST_to_end(&ret, &last, new_var_decl);
+		ast_array_builder_add(decls, parseVarIdent(idTemp));
 	}
-
-	return ret;
 }
 
 // go to next ident
-AST_list parseVarIdent(token idTemp)
+AST *parseVarIdent(token idTemp)
 {
 	token idToken = currToken;
 
 	eat(identsym);
 
-	return ast_list_singleton(ast_var_decl(idTemp, idToken.text));
+	AST *ret = ast_var_decl(idTemp, idToken.text);
+	if (check_scopes)
+		scope_check_varDecl(ret);
+
+	return ret;
 }
 
 // -----------------------------stmts-----------------------------
 
-// may not need
-// wrapper function for parseStmt
+// wrapper function for parseStmt,
+// which parses a long begin statement in parallel when it can
 AST *parseStmts()
 {
 	AST *ret = NULL;
-		
-	ret = parseStmt();
+
+	if (parse_threads > 1 && !check_scopes && currToken.typ == beginsym)
+		ret = parseBeginStmtInParallel();
+
+	if (ret == NULL)
+		ret = parseStmt();
 
 	return ret;
 }
 
+
 // checks if token can begin a stmt
 bool is_stmt_beginning_token(token t)
 {
@@ -282,6 +353,52 @@ bool is_stmt_beginning_token(token t)
 	return false;
 }
 
+// kinds of statements whose parsing is suspended
+// while one of their nested statements is parsed
+typedef enum {
+	begin_frame,	// waiting for the next statement in the list
+	then_frame,		// waiting for the then-part of an if
+	else_frame,		// waiting for the else-part of an if
+	while_frame		// waiting for the body of a while
+} stmt_frame_kind;
+
+// a suspended begin, if, or while statement
+typedef struct {
+	stmt_frame_kind kind;
+	token first;		// the begin, if, or while token
+	AST *cond;			// for if and while statements
+	AST *thenstmt;		// for if statements, once the then-part is parsed
+	AST_array_builder stmts;	// for begin statements, the statements so far
+} stmt_frame;
+
+// the stack of suspended statements, which grows as needed,
+// so that nesting is limited by memory rather than the C stack
+static _Thread_local stmt_frame *stmt_stack = NULL;
+static _Thread_local unsigned int stmt_stack_size = 0;
+static _Thread_local unsigned int stmt_stack_capacity = 0;
+
+// push a suspended statement of the given kind on stmt_stack
+// and return (a pointer to) it
+static stmt_frame *push_stmt_frame(stmt_frame_kind kind, token first)
+{
+	if (stmt_stack_size == stmt_stack_capacity)
+	{
+		stmt_stack_capacity = (stmt_stack_capacity == 0) ? 64 : 2 * stmt_stack_capacity;
+		stmt_stack = realloc(stmt_stack, stmt_stack_capacity * sizeof(stmt_frame));
+		if (stmt_stack == NULL)
+			bail_with_error("No space to parse nested statements!");
+	}
+
+	stmt_frame *f = &stmt_stack[stmt_stack_size++];
+	f->kind = kind;
+	f->first = first;
+	f->cond = NULL;
+	f->thenstmt = NULL;
+	ast_array_builder_init(&f->stmts);
+
+	return f;
+}
+
 // <stmt> ::= <ident> := <expr>
 // | begin <stmt> {<semi-stmt>} end
 // | if <condition> then <stmt> else <stmt>
@@ -289,39 +406,103 @@ bool is_stmt_beginning_token(token t)
 // | read <ident>
 // | write <expr>
 // | skip
+// <semi-stmt> ::= ; <stmt>
+// Begin, if, and while statements are not parsed by recursion;
+// instead each one is pushed on stmt_stack while its nested statements
+// are parsed, and is finished when they have all been parsed.
 AST* parseStmt()
 {
+	unsigned int base = stmt_stack_size;
 	AST *ret = NULL;
+	stmt_frame *f;
 
-	switch (currToken.typ)
+	for (;;)
 	{
-		case identsym:
-			ret = parseAssignStmt();
-			break;
-		case beginsym:
-			ret = parseBeginStmt();
-			break;
-		case ifsym:
-			ret = parseIfStmt();
-			break;
-		case whilesym:
-			ret = parseWhileStmt();
-			break;
-		case readsym:
-			ret = parseReadStmt();
-			break;
-		case writesym:
-			ret = parseWriteStmt();
-			break;
-		case skipsym:
-			ret = parseSkipStmt();
-			break;
-		default:
-			parse_error_unexpected(can_begin_stmt, STMTBEGINTOKS, currToken);
-			break;
-	}
+		// parse the start of a statement, up to a nested statement if it has one
+		switch (currToken.typ)
+		{
+			case identsym:
+				ret = keep_unless_checked(parseAssignStmt());
+				break;
+			case beginsym:
+				push_stmt_frame(begin_frame, currToken);
+				eat(beginsym);
+				continue;
+			case ifsym:
+				f = push_stmt_frame(then_frame, currToken);
+				eat(ifsym);
+				f->cond = keep_unless_checked(parseCondition());
+				eat(thensym);
+				continue;
+			case whilesym:
+				f = push_stmt_frame(while_frame, currToken);
+				eat(whilesym);
+				f->cond = keep_unless_checked(parseCondition());
+				eat(dosym);
+				continue;
+			case readsym:
+				ret = keep_unless_checked(parseReadStmt());
+				break;
+			case writesym:
+				ret = keep_unless_checked(parseWriteStmt());
+				break;
+			case skipsym:
+				ret = keep_unless_checked(parseSkipStmt());
+				break;
+			default:
+				parser_error_unexpected(can_begin_stmt, STMTBEGINTOKS, currToken);
+				break;
+		}
 
-	return ret;
+		// ret is a complete statement (or NULL, if it has been checked and freed),
+		// so give it to the innermost suspended one,
+		// finishing suspended statements until one needs another nested statement
+		bool need_stmt = false;
+		while (!need_stmt && stmt_stack_size > base)
+		{
+			f = &stmt_stack[stmt_stack_size - 1];
+			switch (f->kind)
+			{
+				case begin_frame:
+					if (ret != NULL)
+						ast_array_builder_add(&f->stmts, ret);
+					if (currToken.typ == semisym)
+					{
+						eat(semisym);
+						need_stmt = true;
+					}
+					else
+					{
+						eat(endsym);
+						unsigned int num_stmts = f->stmts.count;
+						ret = check_scopes ? NULL
+							: ast_begin_stmt(f->first, num_stmts,
+											 ast_array_builder_finish(&f->stmts));
+						stmt_stack_size--;
+					}
+					break;
+				case then_frame:
+					f->thenstmt = ret;
+					eat(elsesym);
+					f->kind = else_frame;
+					need_stmt = true;
+					break;
+				case else_frame:
+					ret = check_scopes ? NULL
+						: ast_if_stmt(f->first, f->cond, f->thenstmt, ret);
+					stmt_stack_size--;
+					break;
+				case while_frame:
+					ret = check_scopes ? NULL
+						: ast_while_stmt(f->first, f->cond, ret);
+					stmt_stack_size--;
+					break;
+			}
+		}
+
+		if (!need_stmt)
+			return ret;
+	}
 }
 
 // -----------------------------assign stmt-----------------------------
@@ -333,6 +514,8 @@ AST* parseAssignStmt()
 	token idToken = currToken;
 
 	eat(identsym);
+	if (check_scopes)
+		scope_check_ident(token2file_loc(idToken), idToken.text);
 	eat(becomessym);
 
 	AST *exp = parseExpr();
@@ -340,171 +523,186 @@ AST* parseAssignStmt()
 	return ast_assign_stmt(idToken, idToken.text, exp);
 }
 
-// <expr> ::= <term> {<add-sub-term>}
-// <add-sub-term> ::= <add-sub> <term>
-// <add-sub> ::= <plus> | <minus>
-AST *parseExpr()
+// an operand of an expression being parsed, with its first token
+typedef struct {
+	AST *exp;
+	token fst;
+} operand_entry;
+
+// an operator waiting for its right operand,
+// or an open parenthesis waiting for its closing one
+typedef struct {
+	bool is_paren;
+	bin_arith_op op;	// if !is_paren
+	token lpt;			// if is_paren, the left parenthesis token
+} operator_entry;
+
+// the stacks of operands and operators of the expressions being parsed,
+// which grow as needed, so that nesting is limited by memory
+// rather than the C stack
+static _Thread_local operand_entry *operand_stack = NULL;
+static _Thread_local unsigned int operand_stack_size = 0;
+static _Thread_local unsigned int operand_stack_capacity = 0;
+static _Thread_local operator_entry *operator_stack = NULL;
+static _Thread_local unsigned int operator_stack_size = 0;
+static _Thread_local unsigned int operator_stack_capacity = 0;
+
+// push the operand exp, whose first token is fst, on operand_stack
+static void push_operand(AST *exp, token fst)
 {
-    token fst = currToken;
-    AST *ltrm = parseTerm();
-    AST *exp = ltrm;
-	AST *rltrm;
-
-    while (is_a_sign(currToken.typ))
+	if (operand_stack_size == operand_stack_capacity)
 	{
-		rltrm = parseAddSubTerm();
-		exp = ast_bin_expr(fst, exp, rltrm->data.op_expr.arith_op, rltrm->data.op_expr.exp);
-    }
+		operand_stack_capacity = (operand_stack_capacity == 0) ? 64 : 2 * operand_stack_capacity;
+		operand_stack = realloc(operand_stack, operand_stack_capacity * sizeof(operand_entry));
+		if (operand_stack == NULL)
+			bail_with_error("No space to parse expressions!");
+	}
 
-	
-    return exp;
+	operand_stack[operand_stack_size].exp = exp;
+	operand_stack[operand_stack_size].fst = fst;
+	operand_stack_size++;
 }
 
-// <term> ::= <factor> {<mult-div-factor>}
-// <factor> ::= <ident> | <sign> <number> | (<expr>)
-// <mult-div-factor> ::= <mult-div> <factor>
-// <mult-div> ::= <mult> | <div>
-AST *parseTerm()
+// push an operator (op) or a left parenthesis (lpt) on operator_stack
+static void push_operator(bool is_paren, bin_arith_op op, token lpt)
 {
-    token fst = currToken;
-    AST *fac = parseFactor();
-    AST *exp = fac;
-	AST *rght;
-
-    while (currToken.typ == multsym || currToken.typ == divsym)
+	if (operator_stack_size == operator_stack_capacity)
 	{
-		rght = parseMultDivFactor();
-		exp = ast_bin_expr(fst, exp, rght->data.op_expr.arith_op, rght->data.op_expr.exp);
-    }
-    return exp;
-}
-
-// <mult-div-factor> ::= <mult-div> <factor>
-AST *parseMultDivFactor()
-{
-    token opt = currToken;
-	AST *exp, *e;
+		operator_stack_capacity = (operator_stack_capacity == 0) ? 64 : 2 * operator_stack_capacity;
+		operator_stack = realloc(operator_stack, operator_stack_capacity * sizeof(operator_entry));
+		if (operator_stack == NULL)
+			bail_with_error("No space to parse expressions!");
+	}
 
-    switch (currToken.typ)
-	{
-		case multsym:
-			eat(multsym);
-			exp = parseFactor();
-			exp = ast_op_expr(opt, multop, exp);
-			return exp;
-			break;
-		case divsym:
-			eat(divsym);
-			e = parseFactor();
-			e = ast_op_expr(opt, divop, e);
-			return e;
-			break;
-		default:;
-			token_type expected[2] = {multsym, divsym};
-			parse_error_unexpected(expected, 2, currToken);
-			break;
-    }
-    // The following should never execute
-    return (AST *) NULL;
+	operator_stack[operator_stack_size].is_paren = is_paren;
+	operator_stack[operator_stack_size].op = op;
+	operator_stack[operator_stack_size].lpt = lpt;
+	operator_stack_size++;
 }
 
-AST *parseAddSubTerm()
+// if tt is an arithmetic operator token, set *op to its operator
+// and return true, otherwise return false
+static bool arith_op_of(token_type tt, bin_arith_op *op)
 {
-    token fst = currToken;
-	AST *exp, *e;
-
-    switch (currToken.typ)
+	switch (tt)
 	{
 		case plussym:
-			eat(plussym);
-			exp = parseTerm();
-			exp = ast_op_expr(fst, addop, exp);
-			return exp;
-			break;
+			*op = addop;
+			return true;
 		case minussym:
-			eat(minussym);
-			e = parseTerm();
-			e = ast_op_expr(fst, subop, e);
-			return e;
-			break;
-		default:;
-			token_type expected[2] = {plussym, minussym};
-			parse_error_unexpected(expected, 2, currToken);
-			break;
-    }
-    // The following should never execute
-    return (AST *) NULL;
+			*op = subop;
+			return true;
+		case multsym:
+			*op = multop;
+			return true;
+		case divsym:
+			*op = divop;
+			return true;
+		default:
+			return false;
+	}
 }
 
-// <factor> ::= <ident> | <sign> <number> | (<expr>)
-// <sign> ::= <plus> | <minus> | <empty>
-// <factor> ::= <ident> | <paren-expr> | <signed-number>
-AST *parseFactor()
+// return how tightly op binds (higher binds tighter)
+static int arith_op_precedence(bin_arith_op op)
 {
-	token remember = currToken;
-    switch (currToken.typ)
-	{
-		case identsym:
-			return parseIdentExpr();
-			break;
-		case lparensym:
-			return parseParenExpr();
-			break;
-		case plussym:
-		case minussym:
-			return parseOpExpr(remember);
-			break;
-		case numbersym:
-			return parseNumber();
-			break;
-		default:;
-			token_type expected[3] = {identsym, lparensym, numbersym};
-			parse_error_unexpected(expected, 3, currToken);
-			break;
-	}
-    // The following should never execute
-    return (AST *)NULL;
+	return (op == multop || op == divop) ? 2 : 1;
 }
 
-AST *parseOpExpr(token remember)
+// Requires: the top of operator_stack is an operator
+//           and operand_stack has its two operands on top
+// replace the top two operands with a bin_expr of them
+// and the top operator, which starts at the left operand's first token
+static void reduce_top_operator()
 {
-	AST *num;
-
-	switch (remember.typ)
-	{
-		case plussym:
-			// eat(plussym);
-			num = parseNumber();
-			return num;
-			break;
-		case minussym:
-			// eat(minussym);
-			num = parseNumber();
-			return num;
-			break;
-		default:;
-			token_type expected[2] = {plussym, minussym};
-			parse_error_unexpected(expected, 2, currToken);
-			break;
-	}
+	operand_entry *left = &operand_stack[operand_stack_size - 2];
+	operand_entry *right = &operand_stack[operand_stack_size - 1];
+	bin_arith_op op = operator_stack[--operator_stack_size].op;
 
-	return NULL;
+	left->exp = ast_bin_expr(left->fst, left->exp, op, right->exp);
+	operand_stack_size--;
 }
 
+// <expr> ::= <term> {<add-sub-term>}
+// <add-sub-term> ::= <add-sub> <term>
+// <add-sub> ::= <plus> | <minus>
+// <term> ::= <factor> {<mult-div-factor>}
+// <mult-div-factor> ::= <mult-div> <factor>
+// <mult-div> ::= <mult> | <div>
+// <factor> ::= <ident> | <sign> <number> | <paren-expr>
 // <paren-expr> ::= ( <expr> )
-AST *parseParenExpr()
+// This parses by operator precedence, so each operator becomes
+// a bin_expr as soon as both of its operands are known
+// (left associative, with * and / binding tighter than + and -).
+// Operands, operators and open parentheses are kept on explicit stacks,
+// so nesting does not recurse in C.
+AST *parseExpr()
 {
-    token lpt = currToken;
+	unsigned int operator_base = operator_stack_size;
+	bin_arith_op op;
 
-    eat(lparensym);
+	for (;;)
+	{
+		// parse a factor, after any number of left parentheses
+		token fst = currToken;
+		switch (currToken.typ)
+		{
+			case identsym:
+				push_operand(parseIdentExpr(), fst);
+				break;
+			case lparensym:
+				push_operator(true, addop, currToken);
+				eat(lparensym);
+				continue;
+			case plussym:
+			case minussym:
+			case numbersym:
+				push_operand(parseNumber(), fst);
+				break;
+			default:;
+				token_type expected[3] = {identsym, lparensym, numbersym};
+				parser_error_unexpected(expected, 3, currToken);
+				break;
+		}
 
-    AST *ret = parseExpr();
+		// after a factor comes an operator, a right parenthesis,
+		// or the end of the expression
+		for (;;)
+		{
+			if (arith_op_of(currToken.typ, &op))
+			{
+				while (operator_stack_size > operator_base
+					   && !operator_stack[operator_stack_size - 1].is_paren
+					   && arith_op_precedence(operator_stack[operator_stack_size - 1].op)
+						  >= arith_op_precedence(op))
+				{
+					reduce_top_operator();
+				}
+				push_operator(false, op, currToken);
+				eat(currToken.typ);
+				break;
+			}
 
-    eat(rparensym);
+			while (operator_stack_size > operator_base
+				   && !operator_stack[operator_stack_size - 1].is_paren)
+			{
+				reduce_top_operator();
+			}
 
-    ret->file_loc = token2file_loc(lpt);
-    
-	return ret;
+			if (operator_stack_size == operator_base)
+			{
+				return operand_stack[--operand_stack_size].exp;
+			}
+
+			// close the innermost parenthesis,
+			// giving its expression the location of the left parenthesis
+			token lpt = operator_stack[--operator_stack_size].lpt;
+			eat(rparensym);
+			operand_entry *e = &operand_stack[operand_stack_size - 1];
+			e->exp->file_loc = token2file_loc(lpt);
+			e->fst = lpt;
+		}
+	}
 }
 
 // is current token a plus or minus?
@@ -522,6 +720,8 @@ AST *parseIdentExpr()
 	// tempToken = currToken;
 
 	eat(identsym);
+	if (check_scopes)
+		scope_check_ident(token2file_loc(idToken), idToken.text);
 
 	return ast_ident(idToken, idToken.text);
 }
@@ -549,7 +749,7 @@ AST *parseNumber()
 			return ast_number(remember, remember.value);
 		default:;
 			token_type expected[3] = {plussym, minussym, numbersym};
-			parse_error_unexpected(expected, 3, currToken);
+			parser_error_unexpected(expected, 3, currToken);
 			break;
 	}
 
@@ -563,84 +763,7 @@ AST *parseNumber()
 // 	return ret;
 // }
 
-// -----------------------------begin stmt-----------------------------
-
-// <begin-stmt> ::= begin <stmt> {<semi-stmt>} end
-AST *parseBeginStmt()
-{
-	token begin_sym = currToken;
-	AST_list ret;
-	AST_list last;
-	AST_list stmt_list;
-
-	eat(beginsym);
-
-	ret = ast_list_singleton(parseStmt());
-	last = ret;
-
-	stmt_list = parseStmtList();
-
-	add_AST_to_end(&ret, &last, ast_list_first(stmt_list));
-
-	eat(endsym);
-
-	return ast_begin_stmt(begin_sym, ret);
-}
-
-// <semi-stmt> ::= ; <stmt>
-AST_list parseStmtList()
-{
-	AST_list ret = ast_list_empty_list();
-	AST_list last = ret;
-	AST *tempStmt;
-
-	while (currToken.typ == semisym)
-	{
-		eat(semisym);
-
-		tempStmt = parseStmt();
-
-		add_AST_to_end(&ret, &last, ast_list_singleton(tempStmt));
-	}
-
-	return ret;
-}
-
-// -----------------------------if stmt-----------------------------
-
-// <if-stmt> ::= if <condition> then <stmt> else <stmt>
-AST* parseIfStmt()
-{
-	if (DEBUG)
-		printf("made it to if\n");
-	AST *cond_stmt, *then_stmt, *else_stmt;
-	token if_sym = currToken;
-
-	eat(ifsym);
-	if (DEBUG)
-		printf("gonna parse cond\n\n");
-
-	cond_stmt = parseCondition();
-
-
-	eat(thensym);
-
-	then_stmt = parseStmt();
-
-	if (DEBUG)
-		printf("parsed then\n");
-
-	eat(elsesym);
-
-	else_stmt = parseStmt();
-
-	if (DEBUG)
-	{
-		printf("currToken type is %d\n", currToken.typ);
-		printf("made it out if\n");
-	}
-	return ast_if_stmt(if_sym, cond_stmt, then_stmt, else_stmt);
-}
+// -----------------------------conditions-----------------------------
 
 // <condition> ::= odd <expr> | <expr> <rel-op> <expr>
 // <rel-op> ::= = | <> | < | <= | > | >=
@@ -714,25 +837,6 @@ rel_op which_one()
 	return op;
 }
 
-// -----------------------------while stmt-----------------------------
-
-// <while-stmt> ::= while <condition> do <stmt>
-AST* parseWhileStmt()
-{
-	AST *cond_stmt, *do_stmt;
-	token while_sym = currToken;
-
-	eat(whilesym);
-
-	cond_stmt = parseCondition();
-
-	eat(dosym);
-
-	do_stmt = parseStmt();
-
-	return ast_while_stmt(while_sym, cond_stmt, do_stmt);
-}
-
 // -----------------------------read stmt-----------------------------
 
 // <read-stmt> ::= read <ident>
@@ -747,7 +851,11 @@ AST* parseReadStmt()
 
 	eat(identsym);
 
-	return ast_read_stmt(read_sym, idToken.text);
+	AST *ret = ast_read_stmt(read_sym, idToken.text);
+	if (check_scopes)
+		scope_check_ident(ret->file_loc, idToken.text);
+
+	return ret;
 }
 
 // -----------------------------write stmt-----------------------------
@@ -775,3 +883,236 @@ AST* parseSkipStmt()
 
 	return ast_skip_stmt(skip_sym);
 }
+
+// -----------------------------streaming-----------------------------
+
+// parse the const and var declarations at the start of a program,
+// returning a program AST that has them but no statement (NULL),
+// so that the statement can then be parsed a piece at a time
+AST *parseDeclsOnly()
+{
+	AST_array_builder const_defs, var_decls;
+
+	parseConstDecls(&const_defs);
+	parseVarDecls(&var_decls);
+
+	file_location floc;
+	if (const_defs.count > 0)
+		floc = const_defs.elems[0]->file_loc;
+	else if (var_decls.count > 0)
+		floc = var_decls.elems[0]->file_loc;
+	else
+		floc = token2file_loc(currToken);
+
+	unsigned int num_cds = const_defs.count;
+	unsigned int num_vds = var_decls.count;
+	AST **cds = ast_array_builder_finish(&const_defs);
+	AST **vds = ast_array_builder_finish(&var_decls);
+
+	return ast_program(floc.filename, floc.line, floc.column, num_cds, cds, num_vds, vds, NULL);
+}
+
+// if the program's statement is a begin statement,
+// eat its begin and return true (so its statements can be parsed
+// one at a time with parseStreamStmt); otherwise return false
+bool parseStreamBegin()
+{
+	if (currToken.typ != beginsym)
+		return false;
+
+	eat(beginsym);
+	return true;
+}
+
+// parse the next statement of the begin statement started by parseStreamBegin
+// and the semicolon after it, or, if it is the last one, the end after it,
+// setting *is_last to whether it was the last one
+AST *parseStreamStmt(bool *is_last)
+{
+	AST *ret = parseStmt();
+
+	if (currToken.typ == semisym)
+	{
+		eat(semisym);
+		*is_last = false;
+	}
+	else
+	{
+		eat(endsym);
+		*is_last = true;
+	}
+
+	return ret;
+}
+
+// parse the period that ends a program
+void parseProgramEnd()
+{
+	eat(periodsym);
+}
+
+// parse a statement, then eat the num_follow tokens of the types in follow,
+// and return the statement, setting *next to the token after them
+// (so a statement that was edited can be parsed again by itself,
+// and it can be checked that what follows it has not changed)
+AST *parseStmtThen(const token_type *follow, unsigned int num_follow, token *next)
+{
+	AST *ret = parseStmt();
+
+	for (unsigned int i = 0; i < num_follow; i++)
+		eat(follow[i]);
+
+	*next = currToken;
+	return ret;
+}
+
+// -----------------------------parallel parsing-----------------------------
+
+// the statements of a begin statement that one thread parses
+typedef struct {
+	const compact_token *tokens;	// all the tokens
+	const unsigned int *seps;	// indexes of the separators around statements
+	unsigned int first;			// the first statement in the chunk
+	unsigned int last;			// just past the last statement in the chunk
+	AST **stmts;				// where to put the statements' ASTs
+	bool failed;				// did a statement not parse?
+} parse_chunk;
+
+// parse the statements of the chunk given by arg, each of which
+// is between the separators (semicolons, begin, or end) in seps
+// with the same index and the next one
+static void *parse_chunk_worker(void *arg)
+{
+	parse_chunk *c = (parse_chunk *) arg;
+	range_tokens = c->tokens;
+
+	if (setjmp(range_failed) == 0)
+	{
+		for (unsigned int i = c->first; i < c->last; i++)
+		{
+			range_next = c->seps[i] + 1;
+			range_end = c->seps[i+1];
+			advance();
+			c->stmts[i] = parseStmt();
+			// the statement must end just before its separator
+			if (range_next != range_end + 1)
+				longjmp(range_failed, 1);
+		}
+	}
+	else
+	{
+		c->failed = true;
+	}
+
+	free(stmt_stack);
+	free(operand_stack);
+	free(operator_stack);
+	return NULL;
+}
+
+// If the whole input has been lexed already, and currToken is the begin of
+// a begin statement with a great many statements, parse the statements
+// in parallel and return the begin statement's AST.
+// The statements are found by scanning ahead for the semicolons that are
+// not nested in another begin statement, and split into chunks
+// that are parsed by separate threads; the ASTs are put in order.
+// If any statement does not parse, return NULL without having advanced,
+// so that it is parsed serially (and the error is reported as usual).
+AST *parseBeginStmtInParallel()
+{
+	const compact_token *tokens;
+	unsigned int num_tokens;
+
+	if (!token_stream_all_tokens(&tokens, &num_tokens))
+		return NULL;
+
+	// the indexes of the begin, the semicolons between its statements, and its end
+	unsigned int begin_index = token_stream_position() - 1;
+	unsigned int num_seps = 0, seps_capacity = 1024;
+	unsigned int *seps = malloc(seps_capacity * sizeof(unsigned int));
+	if (seps == NULL)
+		bail_with_error("No space to parse in parallel!");
+
+	unsigned int depth = 0;
+	unsigned int i;
+	for (i = begin_index; i < num_tokens; i++)
+	{
+		token_type tt = tokens[i].typ;
+		bool is_sep = false;
+		if (tt == beginsym)
+			is_sep = (depth++ == 0);
+		else if (tt == endsym)
+			is_sep = (--depth == 0);
+		else if (tt == semisym)
+			is_sep = (depth == 1);
+		else if (tt == eofsym)
+			break;
+
+		if (is_sep)
+		{
+			if (num_seps == seps_capacity)
+			{
+				seps_capacity *= 2;
+				seps = realloc(seps, seps_capacity * sizeof(unsigned int));
+				if (seps == NULL)
+					bail_with_error("No space to parse in parallel!");
+			}
+			seps[num_seps++] = i;
+		}
+		if (depth == 0)
+			break;
+	}
+
+	unsigned int num_stmts = num_seps - 1;
+	if (depth != 0 || num_stmts < PARALLEL_PARSE_MIN_STMTS)
+	{
+		free(seps);
+		return NULL;
+	}
+
+	unsigned int n = parse_threads;
+	parse_chunk *chunks = malloc(n * sizeof(parse_chunk));
+	pthread_t *threads = malloc(n * sizeof(pthread_t));
+	AST **stmts = alloc_list_malloc(num_stmts * sizeof(AST *));
+	if (chunks == NULL || threads == NULL || stmts == NULL)
+		bail_with_error("No space to parse in parallel!");
+
+	for (unsigned int t = 0; t < n; t++)
+	{
+		chunks[t].tokens = tokens;
+		chunks[t].seps = seps;
+		chunks[t].first = (unsigned int) ((unsigned long long) num_stmts * t / n);
+		chunks[t].last = (unsigned int) ((unsigned long long) num_stmts * (t+1) / n);
+		chunks[t].stmts = stmts;
+		chunks[t].failed = false;
+		if (pthread_create(&threads[t], NULL, parse_chunk_worker, &chunks[t]) != 0)
+			bail_with_error("Unable to start a thread for parsing!");
+	}
+
+	bool failed = false;
+	for (unsigned int t = 0; t < n; t++)
+	{
+		pthread_join(threads[t], NULL);
+		failed = failed || chunks[t].failed;
+	}
+
+	AST *ret = NULL;
+	if (!failed)
+	{
+		// continue serially from the begin statement's end
+		token_stream_seek(seps[num_seps - 1]);
+		token begin_token = currToken;
+		advance();
+		eat(endsym);
+		ret = ast_begin_stmt(begin_token, num_stmts, stmts);
+	}
+	else
+	{
+		alloc_list_free(stmts);
+	}
+
+	free(seps);
+	free(chunks);
+	free(threads);
+	return ret;
+}
@@ -2,6 +2,7 @@
 #define _PARSER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "ast.h"
 #include "token.h"
 
@@ -9,67 +10,91 @@ void advance();
 
 void eat(token_type tt);
 
-// call lexer open
+// open the token stream (and so the lexer)
 void parser_open(const char *filename);
 
-// call lexer close
+// open the token stream (and so the lexer) on the given buffer,
+// which must not change until parser_close is called
+void parser_open_buffer(const char *buf, size_t len, const char *display_name);
+
+// open the token stream (and so the lexer) on the given buffer,
+// starting at the given offset (see lexer_open_buffer_at)
+void parser_open_buffer_at(const char *buf, size_t len, const char *display_name,
+						   size_t offset);
+
+// close the token stream (and so the lexer)
 void parser_close();
 
+// Set whether parsing also does the scope checking of scope_check.h.
+// When on, each declaration is put in the symbol table and
+// each use of an identifier is checked as soon as it is parsed,
+// and ASTs are freed as soon as they are checked,
+// so the whole program's AST is never kept and parseyParse returns NULL.
+// Requires: if on, scope_initialize() has been called
+void parser_set_scope_checking(bool on);
+
+// Set the number of threads used to parse the statements of
+// long begin statements (the default is 1). This only happens when
+// the whole input has been lexed already (see lexer_set_threads),
+// and the result (including any error) is the same as with one thread.
+void parser_set_threads(unsigned int num_threads);
+
 // parse program to return AST
 AST *parseyParse();
 
 AST *parseBlock();
 
-AST_list parseConstDecls();
+// To parse a program a statement at a time (instead of with parseyParse):
+// parse its declarations with parseDeclsOnly, then, if parseStreamBegin
+// returns true, call parseStreamStmt until it sets *is_last
+// (otherwise parse its statement with parseStmt),
+// and finally call parseProgramEnd.
+AST *parseDeclsOnly();
 
-AST_list parseConstDecl(token const_sym);
+bool parseStreamBegin();
 
-AST_list parseConstIdent(token idTemp);
+AST *parseStreamStmt(bool *is_last);
 
-AST_list parseVarDecls();
+void parseProgramEnd();
 
-AST_list parseVarDecl();
+// To parse a statement again by itself (after its text was edited),
+// open the parser at its offset with parser_open_buffer_at
+// and call parseStmtThen, giving the tokens that should follow it,
+// which sets *next to the token after them.
+AST *parseStmtThen(const token_type *follow, unsigned int num_follow, token *next);
 
-AST_list parseVarIdent(token idTemp);
+void parseConstDecls(AST_array_builder *cds);
 
-AST *parseStmts();
+void parseConstDecl(token const_sym, AST_array_builder *decls);
 
-AST* parseStmt();
+AST *parseConstIdent(token idTemp);
 
-bool is_stmt_beginning_token(token t);
+void parseVarDecls(AST_array_builder *vds);
 
-AST* parseAssignStmt();
+void parseVarDecl(AST_array_builder *decls);
 
-AST_list parseExpr();
+AST *parseVarIdent(token idTemp);
+
+AST *parseStmts();
 
-AST *parseTerm();
+AST *parseBeginStmtInParallel();
 
-AST *parseFactor();
+AST* parseStmt();
 
-AST *parseMultDivFactor();
+bool is_stmt_beginning_token(token t);
 
-bool is_a_sign(token_type tt);
+AST* parseAssignStmt();
 
-AST *parseAddSubTerm();
+AST *parseExpr();
 
-AST *parseOpExpr(token remember);
+bool is_a_sign(token_type tt);
 
 AST *parseIdentExpr();
 
 AST* parseNumber();
 
-AST *parseParenExpr();
-
-AST* parseBeginStmt();
-
-AST* parseStmtList();
-
-AST* parseIfStmt();
-
 rel_op which_one();
 
-AST* parseWhileStmt();
-
 AST* parseReadStmt();
 
 AST* parseWriteStmt();
@@ -0,0 +1,340 @@
+// parse only the statement enclosing an edit again (see reparse.h)
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reparse.h"
+#include "ast_visitor.h"
+#include "parser.h"
+#include "utilities.h"
+
+// The most statements (from the innermost one enclosing an edit outwards)
+// that are parsed again before giving up and parsing the whole program
+#define REPARSE_MAX_TRIES 3
+
+// A place in a text, as a line and column (both starting at 1)
+typedef struct {
+    unsigned int line;
+    unsigned int column;
+} text_pos;
+
+// Return a negative number, 0, or a positive number
+// according to whether p comes before, is the same as, or comes after q
+static int pos_cmp(text_pos p, text_pos q)
+{
+    if (p.line != q.line) {
+	return (p.line < q.line) ? -1 : 1;
+    }
+    if (p.column != q.column) {
+	return (p.column < q.column) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Return the place where the AST ast starts
+static text_pos ast_pos(const AST *ast)
+{
+    text_pos p = { ast->file_loc.line, ast->file_loc.column };
+    return p;
+}
+
+// Return the place of the char at offset in text
+// (columns count chars, as in the lexer)
+static text_pos pos_of_offset(const char *text, size_t offset)
+{
+    text_pos p = { 1, 1 };
+    size_t line_start = 0;
+    const char *nl;
+    while ((nl = memchr(text + line_start, '\n', offset - line_start)) != NULL) {
+	p.line++;
+	line_start = nl - text + 1;
+    }
+    p.column = offset - line_start + 1;
+    return p;
+}
+
+// Return the offset in text (of len chars) of the place p
+static size_t offset_of_pos(const char *text, size_t len, text_pos p)
+{
+    size_t line_start = 0;
+    for (unsigned int ln = 1; ln < p.line; ln++) {
+	const char *nl = memchr(text + line_start, '\n', len - line_start);
+	if (nl == NULL) {
+	    return len;
+	}
+	line_start = nl - text + 1;
+    }
+    return line_start + p.column - 1;
+}
+
+// An edit that replaced the chars between start and old_end in the old text
+// by those between start and new_end in the new one
+typedef struct {
+    text_pos start;
+    text_pos old_end;
+    text_pos new_end;
+} text_edit;
+
+// Requires: pos_cmp(p, e->old_end) >= 0
+// Return where the char at the place p in the old text is in the new one
+static text_pos shifted(const text_edit *e, text_pos p)
+{
+    if (p.line == e->old_end.line) {
+	p.column = p.column - e->old_end.column + e->new_end.column;
+    }
+    p.line = p.line - e->old_end.line + e->new_end.line;
+    return p;
+}
+
+// A statement that encloses an edit, and what must follow it
+typedef struct {
+    AST **slot;          // where the statement is kept in its parent
+    text_pos start;      // where it starts
+    bool at_eof;         // does what follows it go to the end of the text?
+    text_pos anchor;     // if not, where the statement after that starts
+    token_type follow;   // the token right after it (eofsym for none)
+    int inherit;         // the index of the statement whose following
+                         // tokens come after that (-1 for none)
+} enclosing_stmt;
+
+// Does the statement described by es enclose the edit e?
+static bool encloses(const enclosing_stmt *es, const text_edit *e)
+{
+    return pos_cmp(es->start, e->start) <= 0
+	&& (es->at_eof || pos_cmp(e->old_end, es->anchor) <= 0);
+}
+
+// Requires: stmt is the statement of outer (at index outer_index)
+//           and the edit e starts at or after stmt
+// Set *inner to describe the child statement of stmt enclosing the edit e,
+// and return true, or return false if there is none
+static bool inner_stmt(AST *stmt, const enclosing_stmt *outer, int outer_index,
+		       const text_edit *e, enclosing_stmt *inner)
+{
+    // by default, the inner statement is followed by what follows stmt
+    inner->at_eof = outer->at_eof;
+    inner->anchor = outer->anchor;
+    inner->follow = eofsym;
+    inner->inherit = outer_index;
+    switch (stmt->type_tag) {
+    case begin_ast: {
+	// find the last statement that starts at or before the edit
+	unsigned int n = stmt->data.begin_stmt.num_stmts;
+	AST **stmts = stmt->data.begin_stmt.stmts;
+	unsigned int lo = 0, hi = n;
+	while (lo < hi) {
+	    unsigned int mid = lo + (hi - lo) / 2;
+	    if (pos_cmp(ast_pos(stmts[mid]), e->start) <= 0) {
+		lo = mid + 1;
+	    } else {
+		hi = mid;
+	    }
+	}
+	if (lo == 0) {
+	    return false;
+	}
+	unsigned int i = lo - 1;
+	inner->slot = &stmts[i];
+	if (i + 1 < n) {
+	    inner->at_eof = false;
+	    inner->anchor = ast_pos(stmts[i + 1]);
+	    inner->follow = semisym;
+	    inner->inherit = -1;
+	} else {
+	    inner->follow = endsym;
+	}
+	break;
+    }
+    case if_ast:
+	if (pos_cmp(ast_pos(stmt->data.if_stmt.elsestmt), e->start) <= 0) {
+	    inner->slot = &stmt->data.if_stmt.elsestmt;
+	} else if (pos_cmp(ast_pos(stmt->data.if_stmt.thenstmt), e->start) <= 0) {
+	    inner->slot = &stmt->data.if_stmt.thenstmt;
+	    inner->at_eof = false;
+	    inner->anchor = ast_pos(stmt->data.if_stmt.elsestmt);
+	    inner->follow = elsesym;
+	    inner->inherit = -1;
+	} else {
+	    return false;
+	}
+	break;
+    case while_ast:
+	inner->slot = &stmt->data.while_stmt.stmt;
+	break;
+    default:
+	return false;
+    }
+    inner->start = ast_pos(*inner->slot);
+    return encloses(inner, e);
+}
+
+// The state of the walk that moves the places of ASTs after an edit
+typedef struct {
+    const text_edit *edit;
+    const AST *skip;  // the statement that was parsed again
+} shift_state;
+
+// Move the place of ast if it comes after the edit
+// (and do not visit the statement that was parsed again)
+static bool shift_pre(AST *ast, void *data)
+{
+    shift_state *s = (shift_state *) data;
+    if (ast == s->skip) {
+	return false;
+    }
+    text_pos p = ast_pos(ast);
+    if (pos_cmp(p, s->edit->old_end) >= 0) {
+	p = shifted(s->edit, p);
+	ast->file_loc.line = p.line;
+	ast->file_loc.column = p.column;
+    }
+    return true;
+}
+
+// Requires: frames[k] is a statement enclosing the edit, and frames[0..k]
+//           are the statements that enclose it (outermost first)
+// Parse the statement of frames[k] again from the new_len chars of new_text
+// and return its AST, or return NULL if it does not parse
+// followed by the same tokens as before
+static AST *reparse_stmt(const enclosing_stmt *frames, int k, const text_edit *e,
+			 const char *new_text, size_t new_len, const char *name)
+{
+    // the tokens that follow the statement (at most one for each
+    // enclosing statement), and the statement after which the rest starts
+    token_type *follow = malloc((k + 1) * sizeof(token_type));
+    if (follow == NULL) {
+	return NULL;
+    }
+    unsigned int num_follow = 0;
+    const enclosing_stmt *last = &frames[k];
+    for (int j = k; j >= 0; j = frames[j].inherit) {
+	if (frames[j].follow != eofsym) {
+	    follow[num_follow++] = frames[j].follow;
+	}
+	last = &frames[j];
+    }
+
+    volatile bool opened = false;
+    AST *stmt = NULL;
+    token next;
+    error_catcher catcher;
+    set_error_catcher(&catcher);
+    if (setjmp(catcher.env) == 0) {
+	size_t offset = offset_of_pos(new_text, new_len, frames[k].start);
+	opened = true;
+	parser_open_buffer_at(new_text, new_len, name, offset);
+	stmt = parseStmtThen(follow, num_follow, &next);
+	ast_keep(stmt);
+	parser_close();
+	opened = false;
+    } else {
+	// the partial ASTs are left in the current allocation list (if any)
+	set_error_catcher(NULL);
+	free(follow);
+	if (opened) {
+	    parser_close();
+	}
+	return NULL;
+    }
+    set_error_catcher(NULL);
+    free(follow);
+
+    if (!last->at_eof) {
+	text_pos anchor = shifted(e, last->anchor);
+	text_pos got = { next.line, next.column };
+	if (next.typ == eofsym || pos_cmp(got, anchor) != 0) {
+	    ast_free(stmt);
+	    return NULL;
+	}
+    }
+    return stmt;
+}
+
+// Try to make prog the AST of the program in new_text
+// by parsing again only the statement that encloses the edit,
+// and return its new AST, or NULL if the program is not changed
+AST *reparse_edit(AST *prog, const char *old_text, size_t old_len,
+		  const char *new_text, size_t new_len, const char *name)
+{
+    // find the edit, from the parts at the start and end that are the same
+    size_t start = 0;
+    while (start < old_len && start < new_len
+	   && old_text[start] == new_text[start]) {
+	start++;
+    }
+    size_t old_end = old_len;
+    size_t new_end = new_len;
+    while (old_end > start && new_end > start
+	   && old_text[old_end - 1] == new_text[new_end - 1]) {
+	old_end--;
+	new_end--;
+    }
+    text_edit e;
+    e.start = pos_of_offset(old_text, start);
+    e.old_end = pos_of_offset(old_text, old_end);
+    e.new_end = pos_of_offset(new_text, new_end);
+
+    // find the statements that enclose the edit, outermost first
+    unsigned int cap = 16;
+    int n = 0;
+    enclosing_stmt *frames = malloc(cap * sizeof(enclosing_stmt));
+    if (frames == NULL) {
+	return NULL;
+    }
+    frames[0].slot = &prog->data.program.stmt;
+    frames[0].start = ast_pos(prog->data.program.stmt);
+    frames[0].at_eof = true;
+    frames[0].follow = periodsym;
+    frames[0].inherit = -1;
+    if (!encloses(&frames[0], &e)) {
+	free(frames);
+	return NULL;
+    }
+    n = 1;
+    for (;;) {
+	if ((unsigned int) n == cap) {
+	    cap *= 2;
+	    enclosing_stmt *grown = realloc(frames, cap * sizeof(enclosing_stmt));
+	    if (grown == NULL) {
+		break;
+	    }
+	    frames = grown;
+	}
+	if (!inner_stmt(*frames[n - 1].slot, &frames[n - 1], n - 1,
+			&e, &frames[n])) {
+	    break;
+	}
+	n++;
+    }
+
+    // parse the innermost statement again, or, if that fails,
+    // the ones around it, from the inside out
+    AST *stmt = NULL;
+    int k;
+    for (k = n - 1; k >= 0 && k >= n - REPARSE_MAX_TRIES; k--) {
+	stmt = reparse_stmt(frames, k, &e, new_text, new_len, name);
+	if (stmt != NULL) {
+	    break;
+	}
+    }
+    if (stmt == NULL) {
+	free(frames);
+	return NULL;
+    }
+
+    // replace the old statement and move the ASTs after the edit
+    AST *old = *frames[k].slot;
+    *frames[k].slot = stmt;
+    free(frames);
+    ast_free(old);
+    shift_state s = { &e, stmt };
+    ast_visitor v = { shift_pre, NULL, &s };
+    ast_walk(prog, &v, 1);
+
+    // a program starts where its first declaration or statement does
+    program_t *p = &prog->data.program;
+    AST *first = (p->num_cds > 0) ? p->cds[0]
+	: (p->num_vds > 0) ? p->vds[0] : p->stmt;
+    prog->file_loc = first->file_loc;
+    return stmt;
+}
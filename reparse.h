@@ -0,0 +1,29 @@
+#ifndef _REPARSE_H
+#define _REPARSE_H
+#include <stddef.h>
+#include "ast.h"
+
+// When a program's text is edited, usually only a small part changes,
+// so instead of parsing all of it again, the smallest statement
+// that encloses the edit can be parsed again by itself
+// and put in place of the old one in the program's AST.
+
+// Requires: prog is the AST of the program whose text is the old_len chars
+//           in old_text, which has no errors, and name is its file name
+// Try to make prog the AST of the program whose text is the new_len chars
+// in new_text, by parsing again (from new_text) only the smallest statement
+// enclosing the edit that changed old_text into new_text (or, if that does
+// not parse with the same tokens after it, a statement enclosing that one),
+// replacing it in prog (and freeing the old one),
+// and updating the file locations of the ASTs after it.
+// The new statement is kept out of the current allocation list
+// (see alloc_list.h), which should be current to free what is left
+// of the statements that did not parse.
+// Return the new statement's AST, or NULL if the edit is not inside
+// a statement that parses again (when prog is not changed,
+// and the whole program should be parsed again).
+extern AST *reparse_edit(AST *prog, const char *old_text, size_t old_len,
+			 const char *new_text, size_t new_len,
+			 const char *name);
+
+#endif
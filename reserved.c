@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include "utilities.h"
 #include "reserved.h"
 
 static const char *reserved_words[NUM_RESERVED_WORDS]
@@ -14,11 +15,49 @@ static token_type reserved_types[NUM_RESERVED_WORDS]
 	   ifsym, thensym, elsesym, whilesym, dosym,
 	   readsym, writesym, skipsym, oddsym};
 
+// Lengths of the words in reserved_words (set by reserved_initialize)
+static size_t reserved_lengths[NUM_RESERVED_WORDS];
+
+// Size of the hash table for reserved words (a power of 2)
+#define RESERVED_HASH_SIZE 32
+
+// Length of the longest reserved word ("procedure")
+#define MAX_RESERVED_LENGTH 9
+
+// Hash table mapping reserved_hash values to indexes
+// in reserved_words (or -1 for an unused slot).
+// The hash is perfect for the reserved words,
+// so each word has its own slot.
+static int reserved_slots[RESERVED_HASH_SIZE];
+
+// Requires: text has at least len chars && len >= 1
+// Return the hash table slot for the first len chars of text,
+// based on len and the first two chars
+// (treating the second char of a one-char text as a null char).
+static unsigned int reserved_hash(const char *text, size_t len)
+{
+    unsigned char c0 = text[0];
+    unsigned char c1 = (len > 1) ? text[1] : '\0';
+    return (len + c0 + 9 * c1) % RESERVED_HASH_SIZE;
+}
+
 // initialize the data structures of the
 // reserved module
 void reserved_initialize()
 {
-    // nothing to do!
+    for (int h = 0; h < RESERVED_HASH_SIZE; h++) {
+	reserved_slots[h] = -1;
+    }
+    for (int i = 0; i < NUM_RESERVED_WORDS; i++) {
+	const char *word = reserved_words[i];
+	reserved_lengths[i] = strlen(word);
+	unsigned int h = reserved_hash(word, reserved_lengths[i]);
+	if (reserved_slots[h] != -1) {
+	    bail_with_error("Reserved words \"%s\" and \"%s\" hash to the same slot!",
+			    reserved_words[reserved_slots[h]], word);
+	}
+	reserved_slots[h] = i;
+    }
 }
 
 // Requires: text != NULL
@@ -27,10 +66,24 @@ void reserved_initialize()
 // else return the token_type identsym
 token_type reserved_type(const char *text)
 {
-    for (int i = 0; i < NUM_RESERVED_WORDS; i++) {
-	if (strcmp(text, reserved_words[i]) == 0) {
-	    return reserved_types[i];
-	}
+    return reserved_lookup(text, strlen(text));
+}
+
+// Requires: text != NULL and text has at least len chars
+// If the first len chars of text are a reserved word,
+// then return its token_type,
+// else return the token_type identsym
+token_type reserved_lookup(const char *text, size_t len)
+{
+    if (len == 0 || len > MAX_RESERVED_LENGTH) {
+	return identsym;
+    }
+    int i = reserved_slots[reserved_hash(text, len)];
+    // the word in the slot may be shorter than the text,
+    // so only compare them if their lengths match
+    if (i >= 0 && reserved_lengths[i] == len
+	&& memcmp(text, reserved_words[i], len) == 0) {
+	return reserved_types[i];
     }
     return identsym;
 }
@@ -1,5 +1,6 @@
 #ifndef _RESERVED_H
 #define _RESERVED_H
+#include <stddef.h>
 #include "token.h"
 
 #define NUM_RESERVED_WORDS 15
@@ -14,4 +15,10 @@ extern void reserved_initialize();
 // else return the token_type nosym
 extern token_type reserved_type(const char *text);
 
+// Requires: text != NULL and text has at least len chars
+// If the first len chars of text are a reserved word,
+// then return its token_type,
+// else return the token_type identsym
+extern token_type reserved_lookup(const char *text, size_t len);
+
 #endif
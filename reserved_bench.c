@@ -0,0 +1,92 @@
+// benchmark the lookup of reserved words: time classifying a mix of
+// reserved words and identifiers with reserved_lookup (a perfect hash)
+// and with a loop that compares the text to each reserved word in turn.
+// (This is not part of the compiler; see the time-reserved target.)
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reserved.h"
+
+// The number of times each word is classified
+#define ROUNDS 2000000
+
+// The reserved words, in the order of their token types in the old loop
+static const char *loop_words[NUM_RESERVED_WORDS]
+	= {"const", "var", "procedure",
+	   "call", "begin", "end",
+	   "if", "then", "else", "while", "do",
+	   "read", "write", "skip", "odd"};
+
+static token_type loop_types[NUM_RESERVED_WORDS]
+	= {constsym, varsym, procsym,
+	   callsym, beginsym, endsym,
+	   ifsym, thensym, elsesym, whilesym, dosym,
+	   readsym, writesym, skipsym, oddsym};
+
+// The words classified: reserved words and typical identifiers
+static const char *sample[]
+	= {"x", "begin", "count", "if", "y", "then", "total", "else", "z",
+	   "while", "index", "do", "end", "varname", "write", "i", "read",
+	   "odd", "procedures", "e", "skip", "var", "const", "n2"};
+
+#define NUM_SAMPLE (sizeof(sample) / sizeof(sample[0]))
+
+// Classify text by comparing it with each reserved word in turn
+// (the way reserved_type used to)
+static token_type loop_lookup(const char *text)
+{
+	for (int i = 0; i < NUM_RESERVED_WORDS; i++)
+	{
+		if (strcmp(text, loop_words[i]) == 0)
+			return loop_types[i];
+	}
+	return identsym;
+}
+
+// Return the number of seconds since start
+static double seconds_since(struct timespec start)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double) (end.tv_sec - start.tv_sec)
+		+ (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main()
+{
+	reserved_initialize();
+	size_t lengths[NUM_SAMPLE];
+	for (size_t w = 0; w < NUM_SAMPLE; w++)
+	{
+		lengths[w] = strlen(sample[w]);
+		if (reserved_lookup(sample[w], lengths[w]) != loop_lookup(sample[w]))
+		{
+			fprintf(stderr, "The lookups disagree about %s\n", sample[w]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// the sums keep the lookups from being optimized away
+	volatile unsigned long sum = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int r = 0; r < ROUNDS; r++)
+		for (size_t w = 0; w < NUM_SAMPLE; w++)
+			sum += loop_lookup(sample[w]);
+	double loop_seconds = seconds_since(start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int r = 0; r < ROUNDS; r++)
+		for (size_t w = 0; w < NUM_SAMPLE; w++)
+			sum += reserved_lookup(sample[w], lengths[w]);
+	double hash_seconds = seconds_since(start);
+
+	double lookups = (double) ROUNDS * NUM_SAMPLE;
+	printf("strcmp loop: %.1f ns per lookup\n", loop_seconds / lookups * 1e9);
+	printf("perfect hash: %.1f ns per lookup\n", hash_seconds / lookups * 1e9);
+	return EXIT_SUCCESS;
+}
@@ -1,7 +1,10 @@
 // By: Vincent Lazo, Christian Manuel
+// for pthreads
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "scope_check.h"
 #include "id_attrs.h"
 #include "file_location.h"
@@ -12,14 +15,40 @@
 
 #define DEBUG 0
 
+// Number of threads to check long begin statements with
+static unsigned int check_threads = 1;
+
+// Begin statements with fewer statements than this are always checked
+// by a single thread
+#define PARALLEL_CHECK_MIN_STMTS 4096
+
+static void scope_check_stmts_in_parallel(unsigned int num_stmts, AST **stmts);
+
+// Set the number of threads used to check the statements
+// of a program whose statement is a long begin statement
+void scope_check_set_threads(unsigned int num_threads)
+{
+    check_threads = (num_threads == 0) ? 1 : num_threads;
+}
+
 // Build the symbol table for the given program AST
 // and Check the given program AST for duplicate declarations
 // or uses of identifiers that were not declared
 void scope_check_program(AST *prog)
 {
-    scope_check_constDecls(prog->data.program.cds);
-    scope_check_varDecls(prog->data.program.vds);
-    scope_check_stmt(prog->data.program.stmt);
+    AST *stmt = prog->data.program.stmt;
+    if (check_threads > 1 && stmt->type_tag == begin_ast
+        && stmt->data.begin_stmt.num_stmts >= PARALLEL_CHECK_MIN_STMTS) {
+        // all declarations come before the statement,
+        // so the symbol table does not change while the statement is checked
+        scope_check_constDecls(prog->data.program.num_cds, prog->data.program.cds);
+        scope_check_varDecls(prog->data.program.num_vds, prog->data.program.vds);
+        scope_check_stmts_in_parallel(stmt->data.begin_stmt.num_stmts,
+                                      stmt->data.begin_stmt.stmts);
+        return;
+    }
+    ast_visitor v = scope_check_visitor();
+    ast_walk(prog, &v, 1);
 }
 
 // Put the given name, which is to be declared with var_type vt, and has its declaration at the given file location (floc), into the current scope's symbol table at the offset scope_size().
@@ -44,12 +73,10 @@ static void add_ident_to_scope(const char *name, id_kind kind, file_location flo
     }
 }
 // build the symbol table and check the declarations in vds
-void scope_check_constDecls(AST_list cds)
+void scope_check_constDecls(unsigned int num_cds, AST **cds)
 {
-    while (!ast_list_is_empty(cds)) {
-        scope_check_constDecl(ast_list_first(cds));
-
-        cds = ast_list_rest(cds);
+    for (unsigned int i = 0; i < num_cds; i++) {
+        scope_check_constDecl(cds[i]);
     }
 }
 
@@ -66,16 +93,15 @@ void scope_check_constDecl(AST *cd)
 }
 
 // build the symbol table and check the declarations in vds
-void scope_check_varDecls(AST_list vds)
+void scope_check_varDecls(unsigned int num_vds, AST **vds)
 {
-    while (!ast_list_is_empty(vds)) {
-        scope_check_varDecl(ast_list_first(vds));
+    for (unsigned int i = 0; i < num_vds; i++) {
+        scope_check_varDecl(vds[i]);
         if (DEBUG)
         {
             printf("after <scope_check_varDecl>\n");
             fflush(stdout);
         }
-        vds = ast_list_rest(vds);
     }
 }
 
@@ -97,139 +123,163 @@ void scope_check_varDecl(AST *vd)
     }    
 }
 
-// check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_stmt(AST *stmt)
+// Return the name of the identifier used (not declared) in ast itself
+// (not in its children), or NULL if there is none
+static const char *used_name(AST *ast)
 {
-    switch (stmt->type_tag) {
+    switch (ast->type_tag) {
     case assign_ast:
-        scope_check_assignStmt(stmt);
-        break;
-    case begin_ast:
-        scope_check_beginStmt(stmt);
-        break;
-    case if_ast:
-        scope_check_ifStmt(stmt);
-        break;
+        return ast->data.assign_stmt.name;
     case read_ast:
-        scope_check_readStmt(stmt);
-        break;
-    case write_ast:
-        scope_check_writeStmt(stmt);
-        break;
-    case while_ast:
-        scope_check_while(stmt);
-        break;
-    case skip_ast:
-        break;
+        return ast->data.read_stmt.name;
+    case ident_ast:
+        return ast->data.ident.name;
     default:
-        bail_with_error("Call to scope_check_stmt with an AST that is not a statement!");
-        break;
+        return NULL;
     }
 }
 
-// check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_assignStmt(AST *stmt)
+// Visit one node of the AST: add declarations to the symbol table
+// and check that identifiers used in statements and expressions
+// have been declared (if not, then produce an error).
+// Always visits the node's children.
+static bool scope_check_node(AST *ast, void *data)
 {
-    scope_check_ident(stmt->file_loc, stmt->data.assign_stmt.name);
-    scope_check_expr(stmt->data.assign_stmt.exp);
-}
-
-// check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_beginStmt(AST *stmt)
-{
-    AST_list stmts = stmt->data.begin_stmt.stmts;
-    while (!ast_list_is_empty(stmts)) {
-	scope_check_stmt(ast_list_first(stmts));
-	stmts = ast_list_rest(stmts);
+    switch (ast->type_tag) {
+    case const_decl_ast:
+        scope_check_constDecl(ast);
+        break;
+    case var_decl_ast:
+        scope_check_varDecl(ast);
+        break;
+    default:
+        if (used_name(ast) != NULL) {
+            scope_check_ident(ast->file_loc, used_name(ast));
+        }
+        break;
     }
+    return true;
 }
 
-void scope_check_while(AST *stmt)
+// Return a visitor that does the scope checking of each node it visits,
+// so that it can share a walk with other passes
+ast_visitor scope_check_visitor()
 {
-    scope_check_cond(stmt->data.while_stmt.cond);
-    scope_check_stmt(stmt->data.while_stmt.stmt);
+    ast_visitor ret = { scope_check_node, NULL, NULL };
+    return ret;
 }
 
 // check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_ifStmt(AST *stmt) 
+void scope_check_stmt(AST *stmt)
 {
-    scope_check_cond(stmt->data.if_stmt.cond);
-    scope_check_stmt(stmt->data.if_stmt.thenstmt);
-    scope_check_stmt(stmt->data.if_stmt.elsestmt);
+    ast_visitor v = scope_check_visitor();
+    ast_walk(stmt, &v, 1);
 }
 
-void scope_check_cond(AST *cond)
+// check that the given name has been declared,
+// if not, then produce an error using the file_location (floc) given.
+void scope_check_ident(file_location floc, const char *name)
 {
-    switch (cond->type_tag) {
-        case odd_cond_ast:
-            scope_check_expr(cond->data.odd_cond.exp);
-            break;
-        case bin_cond_ast:
-            scope_check_bin_expr(cond);
-            break;
-        default:
-            bail_with_error("Unexpected type_tag (%d) in scope_check_expr (for line %d, column %d)!",
-			cond->type_tag, cond->file_loc.line, cond->file_loc.column);
-            break;
+    if (!scope_defined(name)) {
+	general_error(floc,
+		      "identifer \"%s\" is not declared!", name);
     }
 }
 
-// check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_readStmt(AST *stmt)
-{
-    scope_check_ident(stmt->file_loc, stmt->data.read_stmt.name);
-}
+// A contiguous part of a begin statement's statements,
+// which one thread checks, recording the first undeclared identifier
+typedef struct {
+    AST **stmts; // the chunk's statements
+    unsigned int num_stmts; // the number of statements in the chunk
+    bool failed; // was an undeclared identifier found?
+    file_location error_loc; // where it was used, if failed
+    const char *error_name; // its name, if failed
+    bool threaded; // is it checked by a thread of its own?
+} check_chunk;
 
-// check the statement to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_writeStmt(AST *stmt)
+// Visit one node in a chunk, recording the first use of an identifier
+// that is not declared in the chunk given by data,
+// and visiting nothing more after that
+static bool scope_check_chunk_node(AST *ast, void *data)
 {
-    scope_check_expr(stmt->data.write_stmt.exp);
+    check_chunk *c = (check_chunk *) data;
+    if (c->failed) {
+        return false;
+    }
+    const char *name = used_name(ast);
+    if (name != NULL && !scope_defined(name)) {
+        c->failed = true;
+        c->error_loc = ast->file_loc;
+        c->error_name = name;
+        return false;
+    }
+    return true;
 }
 
-// check the expresion to make sure that all idenfifiers referenced in it have been declared (if not, then produce an error)
-void scope_check_expr(AST *exp)
+// Check the statements of the chunk given by arg
+// (only looking names up in the symbol table, which is not changing)
+static void *scope_check_chunk_worker(void *arg)
 {
-    switch (exp->type_tag) {
-    case ident_ast:
-	scope_check_ident(exp->file_loc, exp->data.ident.name);
-	break;
-    case bin_expr_ast:
-	scope_check_bin_expr(exp);
-	break;
-    case number_ast:
-	// no identifiers are possible in this case, so just return
-	break;
-    // case op_expr_ast:
-	// scope_check_expr(exp->data.op_expr.exp);
-	break;
-    default:
-	bail_with_error("Unexpected type_tag (%d) in scope_check_expr (for line %d, column %d)!",
-			exp->type_tag, exp->file_loc.line, exp->file_loc.column);
-	break;
+    check_chunk *c = (check_chunk *) arg;
+    ast_visitor v = { scope_check_chunk_node, NULL, c };
+    for (unsigned int i = 0; i < c->num_stmts && !c->failed; i++) {
+        ast_walk(c->stmts[i], &v, 1);
     }
+    return NULL;
 }
 
-// check that the given name has been declared,
-// if not, then produce an error using the file_location (floc) given.
-void scope_check_ident(file_location floc, const char *name)
+// Requires: the symbol table holds all the declarations
+// check the num_stmts statements in stmts, as scope_check_stmt would,
+// but splitting them into chunks that are checked by separate threads;
+// if any identifiers are not declared, the error is reported
+// for the first one in the source (as when checking serially)
+static void scope_check_stmts_in_parallel(unsigned int num_stmts, AST **stmts)
 {
-    if (!scope_defined(name)) {
-	general_error(floc,
-		      "identifer \"%s\" is not declared!", name);
+    unsigned int n = check_threads;
+    check_chunk *chunks = (check_chunk *) malloc(n * sizeof(check_chunk));
+    pthread_t *threads = (pthread_t *) malloc(n * sizeof(pthread_t));
+    if (chunks == NULL || threads == NULL) {
+        free(chunks);
+        free(threads);
+        bail_with_error("No space to check statements in parallel!");
     }
-}
 
-// check the expression (exp) to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-// void scope_check_bin_expr(AST *exp)
-// {
-//     scope_check_expr(exp->data.bin_expr.leftexp);
-//     scope_check_expr(exp->data.bin_expr.rightexp);
-// }
+    for (unsigned int t = 0; t < n; t++) {
+        unsigned int start = (unsigned int) ((unsigned long long) num_stmts * t / n);
+        unsigned int end = (unsigned int) ((unsigned long long) num_stmts * (t+1) / n);
+        chunks[t].stmts = stmts + start;
+        chunks[t].num_stmts = end - start;
+        chunks[t].failed = false;
+        chunks[t].threaded = pthread_create(&threads[t], NULL,
+                                            scope_check_chunk_worker,
+                                            &chunks[t]) == 0;
+        if (!chunks[t].threaded) {
+            // no thread could be started, so check it on this one
+            scope_check_chunk_worker(&chunks[t]);
+        }
+    }
+    for (unsigned int t = 0; t < n; t++) {
+        if (chunks[t].threaded) {
+            pthread_join(threads[t], NULL);
+        }
+    }
 
-void scope_check_bin_expr(AST *cond)
-{
-    scope_check_expr(cond->data.bin_expr.leftexp);
-    scope_check_expr(cond->data.bin_expr.rightexp);
-}
\ No newline at end of file
+    // the chunks are in source order, so the first failure is the earliest;
+    // it is reported after the arrays are freed, as reporting it
+    // may jump to an error catcher
+    bool failed = false;
+    file_location error_loc;
+    const char *error_name = NULL;
+    for (unsigned int t = 0; t < n && !failed; t++) {
+        if (chunks[t].failed) {
+            failed = true;
+            error_loc = chunks[t].error_loc;
+            error_name = chunks[t].error_name;
+        }
+    }
+    free(chunks);
+    free(threads);
+    if (failed) {
+        scope_check_ident(error_loc, error_name);
+    }
+}
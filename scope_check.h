@@ -1,14 +1,27 @@
 #ifndef _SCOPE_CHECK_H
 #define _SCOPE_CHECK_H
 #include "ast.h"
+#include "ast_visitor.h"
+
+// Set the number of threads used to check the statements
+// of a program whose statement is a long begin statement
+// (the default is 1). The symbol table is only read while
+// statements are checked, so the threads share it without locking,
+// and errors are reported just as when checking with one thread.
+extern void scope_check_set_threads(unsigned int num_threads);
 
 // Build the symbol table for the given program AST
 // and Check the given program AST for duplicate declarations
 // or uses of identifiers that were not declared
 extern void scope_check_program(AST *prog);
 
-// build the symbol table and check the declarations in vds
-extern void scope_check_varDecls(AST *vds);
+// Return a visitor that builds the symbol table from the declarations
+// and checks the identifiers in each node it visits,
+// for use in a walk (see ast_visitor.h) fused with other passes
+extern ast_visitor scope_check_visitor();
+
+// build the symbol table and check the num_vds declarations in vds
+extern void scope_check_varDecls(unsigned int num_vds, AST **vds);
 
 // check the var declaration vd
 // and add it to the current scope's symbol table
@@ -20,54 +33,14 @@ extern void scope_check_varDecl(AST *vd);
 // (if not, then produce an error)
 extern void scope_check_stmt(AST *stmt);
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_assignStmt(AST *stmt);
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_beginStmt(AST *stmt);
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_ifStmt(AST *stmt);
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_readStmt(AST *stmt);
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_writeStmt(AST *stmt);
-
-// check the expresion to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_expr(AST *exp);
-
 // check that the given name has been declared,
 // if not, then produce an error using the file_location (floc) given.
 extern void scope_check_ident(file_location floc, const char *name);
 
-// check the expression (exp) to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_bin_expr(AST *exp);
-
-void scope_check_constDecls(AST_list cds);
+void scope_check_constDecls(unsigned int num_cds, AST **cds);
 
 void scope_check_constDecl(AST *cd);
 
-void scope_check_cond(AST *cond);
-
-void scope_check_while(AST *stmt);
-
-
 // I ADDED THIS CUZ I CANT FIND THIS FUNCTION ANYWHERE ELSE IN THE HEADER FILES
 //extern void add_ident_to_scope(const char *name, var_type vt, file_location floc);
 
@@ -117,4 +117,35 @@ id_attrs *scope_lookup(const char *name)
     }
     // assert(i == symtab->size);
     return NULL;
-}
\ No newline at end of file
+}
+// Requires: i < scope_size()
+// Return the name of the i-th declaration in the current scope
+const char *scope_name_at(unsigned int i)
+{
+    // assert(i < symtab->size);
+    return symtab->entries[i]->id;
+}
+
+// Requires: i < scope_size()
+// Return (a pointer to) the attributes of the i-th declaration
+// in the current scope
+id_attrs *scope_attrs_at(unsigned int i)
+{
+    // assert(i < symtab->size);
+    return symtab->entries[i]->attrs;
+}
+
+// Free the current scope's symbol table and the attributes in it
+// (but not the names, which belong to the ASTs)
+void scope_finalize()
+{
+    if (symtab == NULL) {
+	return;
+    }
+    for (unsigned int i = 0; i < symtab->size; i++) {
+	free(symtab->entries[i]->attrs);
+	free(symtab->entries[i]);
+    }
+    free(symtab);
+    symtab = NULL;
+}
@@ -32,4 +32,19 @@ extern void scope_insert(const char *name, id_attrs *attrs);
 // or NULL if there is no association for name.
 extern id_attrs *scope_lookup(const char *name);
 
+// Requires: i < scope_size()
+// Return the name of the i-th declaration in the current scope
+// (in the order they were inserted)
+extern const char *scope_name_at(unsigned int i);
+
+// Requires: i < scope_size()
+// Return (a pointer to) the attributes of the i-th declaration
+// in the current scope (in the order they were inserted)
+extern id_attrs *scope_attrs_at(unsigned int i);
+
+// Free the current scope's symbol table and the attributes in it
+// (but not the names, which belong to the ASTs),
+// after which scope_initialize must be called before it is used again
+extern void scope_finalize();
+
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "token.h"
 
 // Translation from enum values to strings
@@ -18,3 +19,24 @@ const char *ttyp2str(token_type ttyp)
 {
     return ttstrs[ttyp];
 }
+
+// The fixed text of each token type (NULL if there is none)
+static const char *tttexts[34] =
+    {".", "const", ";", ",",
+    "var", "procedure", ":=", "call", "begin", "end",
+    "if", "then", "else", "while", "do",
+    "read", "write", "skip",
+    "odd", "(", ")",
+    NULL, NULL,
+    "=", "<>", "<", "<=", ">", ">=",
+    "+", "-", "*", "/",
+    NULL};
+
+// Return the text that every token of type ttyp has
+// (e.g., ":=" for becomessym),
+// or NULL if tokens of that type have no fixed text
+// (identsym, numbersym and eofsym)
+const char *ttyp2text(token_type ttyp)
+{
+    return tttexts[ttyp];
+}
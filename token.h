@@ -23,12 +23,29 @@ typedef struct token {
     const char *filename;
     unsigned int line;
     unsigned int column;
-    char *text; // non-NULL, if applicable
+    const char *text; // non-NULL, if applicable
     short int value; // when typ==numbersym, its value
 } token;
 
+// A compact form of a token, used when many tokens are buffered.
+// It has no file name, line, column or text of its own;
+// instead it records where its text is in the lexer's input,
+// from which the lexer can recover the full token (see lexer_expand).
+typedef struct {
+    unsigned int offset; // of the token's first char in the input
+    unsigned short int length; // number of chars in the token's text
+    short int value; // when typ==numbersym, its value
+    unsigned char typ; // the token's token_type
+} compact_token;
+
 // Return the name of the token_type enum
 // corresponding to the given token_type value
 extern const char *ttyp2str(token_type ttyp);
 
+// Return the text that every token of type ttyp has
+// (e.g., ":=" for becomessym),
+// or NULL if tokens of that type have no fixed text
+// (identsym, numbersym and eofsym)
+extern const char *ttyp2text(token_type ttyp);
+
 #endif
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include "utilities.h"
+#include "lexer.h"
+#include "token_stream.h"
+
+// Initial number of slots in the ring buffer (a power of 2)
+#define INITIAL_RING_SIZE 64
+
+// The ring buffer of lexed but unconsumed tokens,
+// kept in compact form and only expanded when they are returned
+static compact_token *ring = NULL;
+// The number of slots in ring (always a power of 2)
+static unsigned int ring_size = 0;
+// The index in ring of the next token to be consumed
+static unsigned int head = 0;
+// The number of tokens in ring waiting to be consumed
+static unsigned int count = 0;
+// The token most recently returned by token_stream_next
+static token last;
+
+// Requires: count == ring_size
+// Double the size of the ring, keeping the buffered tokens in order
+static void token_stream_grow()
+{
+    unsigned int new_size = 2 * ring_size;
+    compact_token *new_ring
+	= (compact_token *) malloc(new_size * sizeof(compact_token));
+    if (new_ring == NULL) {
+	bail_with_error("No space to grow the token stream!");
+    }
+    for (unsigned int i = 0; i < count; i++) {
+	new_ring[i] = ring[(head + i) & (ring_size - 1)];
+    }
+    free(ring);
+    ring = new_ring;
+    ring_size = new_size;
+    head = 0;
+}
+
+// Lex tokens into the ring until it holds at least n tokens
+// or the lexer is done
+static void token_stream_fill(unsigned int n)
+{
+    while (count < n && !lexer_done()) {
+	if (count == ring_size) {
+	    token_stream_grow();
+	}
+	ring[(head + count) & (ring_size - 1)] = lexer_next_compact();
+	count++;
+    }
+}
+
+// Requires: the lexer has just been opened on the input named display_name
+// Start an empty stream reading from the lexer
+static void token_stream_start(const char *display_name)
+{
+    ring_size = INITIAL_RING_SIZE;
+    ring = (compact_token *) malloc(ring_size * sizeof(compact_token));
+    if (ring == NULL) {
+	bail_with_error("No space for the token stream!");
+    }
+    head = 0;
+    count = 0;
+    last.typ = eofsym;
+    last.filename = display_name;
+    last.line = 1;
+    last.column = 1;
+    last.text = NULL;
+    last.value = 0;
+}
+
+// Requires: fname != NULL
+// Requires: fname is the name of a readable file, or "-"
+// Open the lexer on the given file name and start an empty stream
+void token_stream_open(const char *fname)
+{
+    lexer_open(fname);
+    token_stream_start(strcmp(fname, "-") == 0 ? LEXER_STDIN_NAME : fname);
+}
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until token_stream_close is called
+// Open the lexer on the given buffer (see lexer_open_buffer)
+// and start an empty stream
+void token_stream_open_buffer(const char *buf, size_t len,
+			      const char *display_name)
+{
+    token_stream_open_buffer_at(buf, len, display_name, 0);
+}
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until token_stream_close is called
+// Open the lexer on the given buffer at the given offset
+// (see lexer_open_buffer_at) and start an empty stream
+void token_stream_open_buffer_at(const char *buf, size_t len,
+				 const char *display_name, size_t offset)
+{
+    lexer_open_buffer_at(buf, len, display_name, offset);
+    token_stream_start(display_name);
+}
+
+// Close the lexer and discard any buffered tokens
+void token_stream_close()
+{
+    lexer_close();
+    free(ring);
+    ring = NULL;
+    ring_size = 0;
+    head = 0;
+    count = 0;
+}
+
+// Return the next token in the stream, advancing past it.
+// Once the stream is exhausted, this keeps returning
+// the last token (which is the eofsym token).
+token token_stream_next()
+{
+    token_stream_fill(1);
+    if (count > 0) {
+	last = lexer_expand(ring[head]);
+	head = (head + 1) & (ring_size - 1);
+	count--;
+    }
+    return last;
+}
+
+// Return the token that token_stream_next would return
+// after k more calls, without advancing the stream
+// (so token_stream_peek(0) is the token the next call returns).
+token token_stream_peek(unsigned int k)
+{
+    token_stream_fill(k+1);
+    if (k < count) {
+	return lexer_expand(ring[(head + k) & (ring_size - 1)]);
+    }
+    // the stream ends before that token, so it would be the last one
+    if (count > 0) {
+	return lexer_expand(ring[(head + count - 1) & (ring_size - 1)]);
+    }
+    return last;
+}
+
+// If the whole input has already been lexed (see lexer_set_threads),
+// set *tokens to the array of all its tokens and *num_tokens to its length,
+// and return true; otherwise return false
+bool token_stream_all_tokens(const compact_token **tokens,
+			     unsigned int *num_tokens)
+{
+    return lexer_prelexed_tokens(tokens, num_tokens);
+}
+
+// Requires: token_stream_all_tokens would return true
+// Return the index (in the array of all tokens) of the token
+// that token_stream_next will return next
+unsigned int token_stream_position()
+{
+    return lexer_prelexed_position() - count;
+}
+
+// Requires: token_stream_all_tokens would return true
+//           and index is less than the number of tokens
+// Make the next token that token_stream_next returns be
+// the one at the given index (in the array of all tokens)
+void token_stream_seek(unsigned int index)
+{
+    head = 0;
+    count = 0;
+    lexer_prelexed_seek(index);
+}
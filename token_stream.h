@@ -0,0 +1,63 @@
+#ifndef _TOKEN_STREAM_H
+#define _TOKEN_STREAM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "token.h"
+
+// A token stream sits between the lexer and the parser.
+// Tokens that have been lexed but not yet consumed are kept in a
+// ring buffer (in compact form), so the parser can look ahead
+// any number of tokens.
+// Tokens are only lexed when the parser asks for them,
+// so lexical errors are reported in the same order as without lookahead.
+
+// Requires: fname != NULL
+// Requires: fname is the name of a readable file, or "-"
+// Open the lexer on the given file name and start an empty stream
+extern void token_stream_open(const char *fname);
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until token_stream_close is called
+// Open the lexer on the given buffer (see lexer_open_buffer)
+// and start an empty stream
+extern void token_stream_open_buffer(const char *buf, size_t len,
+				     const char *display_name);
+
+// Requires: buf != NULL, buf holds len chars, and display_name != NULL
+// Requires: buf is not changed or freed until token_stream_close is called
+// Open the lexer on the given buffer at the given offset
+// (see lexer_open_buffer_at) and start an empty stream
+extern void token_stream_open_buffer_at(const char *buf, size_t len,
+					const char *display_name, size_t offset);
+
+// Close the lexer and discard any buffered tokens
+extern void token_stream_close();
+
+// Return the next token in the stream, advancing past it.
+// Once the stream is exhausted, this keeps returning
+// the last token (which is the eofsym token).
+extern token token_stream_next();
+
+// Return the token that token_stream_next would return
+// after k more calls, without advancing the stream
+// (so token_stream_peek(0) is the token the next call returns).
+extern token token_stream_peek(unsigned int k);
+
+// If the whole input has already been lexed (see lexer_set_threads),
+// set *tokens to the array of all its tokens and *num_tokens to its length,
+// and return true; otherwise return false
+extern bool token_stream_all_tokens(const compact_token **tokens,
+				    unsigned int *num_tokens);
+
+// Requires: token_stream_all_tokens would return true
+// Return the index (in the array of all tokens) of the token
+// that token_stream_next will return next
+extern unsigned int token_stream_position();
+
+// Requires: token_stream_all_tokens would return true
+//           and index is less than the number of tokens
+// Make the next token that token_stream_next returns be
+// the one at the given index (in the array of all tokens)
+extern void token_stream_seek(unsigned int index);
+
+#endif
@@ -1,346 +1,767 @@
 /* $Id: unparser.c,v 1.6 2023/02/20 03:55:32 leavens Exp $ */
+// for open_memstream
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "ast.h"
+#include "ast_visitor.h"
+#include "alloc_list.h"
 #include "utilities.h"
 #include "unparserInternal.h"
 
 // Amount of spaces to indent per nesting level
 #define SPACES_PER_LEVEL 2
 
-// Print SPACES_PER_LEVEL * level spaces to out
-static void indent(FILE *out, int level)
+// Size of the buffer that output is collected in before it is written
+#define UNPARSE_BUFFER_SIZE (1 << 16)
+
+// The unparser's output is collected in unparse_buffer
+// and written to unparse_out (with fwrite) when the buffer is full,
+// when output is directed to a different file,
+// or when the outermost public unparsing function returns,
+// so the output is written in large chunks rather than a token at a time.
+// Each thread has its own buffer (see unparseStmtList).
+static _Thread_local char unparse_buffer[UNPARSE_BUFFER_SIZE];
+static _Thread_local size_t unparse_buffer_len = 0;
+static _Thread_local FILE *unparse_out = NULL;
+
+// Number of public unparsing functions that are running
+// (these call each other, but only the outermost one flushes the buffer)
+static _Thread_local unsigned int unparse_nesting = 0;
+
+// Number of threads to use for unparsing long statement lists
+static unsigned int unparse_threads = 1;
+
+// Statement lists shorter than this are always unparsed by a single thread
+#define PARALLEL_UNPARSE_MIN_STMTS 4096
+
+// Is this thread a worker for a statement list being unparsed in parallel?
+// (If so, it does not start more threads.)
+static _Thread_local bool in_unparse_worker = false;
+
+// Set the number of threads used to unparse long statement lists
+void unparser_set_threads(unsigned int num_threads)
+{
+    unparse_threads = (num_threads == 0) ? 1 : num_threads;
+}
+
+// Are expressions printed with only the parentheses they need?
+static bool minimal_parens = false;
+
+// Set whether expressions are printed with only the parentheses needed
+void unparser_set_minimal_parens(bool on)
 {
-    int num = SPACES_PER_LEVEL * level;
-    for (int i = 0; i < num; i++) {
-	fprintf(out, " ");
+    minimal_parens = on;
+}
+
+// The comments to put into the output (in source order),
+// and the index of the first one not yet output
+static lexer_comment *unparse_comments = NULL;
+static unsigned int num_unparse_comments = 0;
+static unsigned int next_comment = 0;
+// The number of begin statements whose end has been put into the output
+// (as comments record how many ends come before them),
+// counted only while there are comments left to output
+static unsigned int ends_unparsed = 0;
+
+// Set the comments to put into the output
+void unparser_set_comments(unsigned int num_comments, lexer_comment *comments)
+{
+    unparse_comments = comments;
+    num_unparse_comments = num_comments;
+    next_comment = 0;
+    ends_unparsed = 0;
+}
+
+
+// Write the contents of the output buffer to unparse_out and empty it
+static void flush_output()
+{
+    if (unparse_buffer_len > 0) {
+	fwrite(unparse_buffer, 1, unparse_buffer_len, unparse_out);
+	unparse_buffer_len = 0;
     }
 }
 
-// Unparse the given program AST and then print a period and an newline
-void unparseProgram(FILE *out, AST *ast)
+// Start a public unparsing function's output
+static void start_output()
 {
-    unparseBlock(out, ast, 0);
-    fprintf(out, ".\n");
+    unparse_nesting++;
 }
 
-// Unparse the given block, indented by the given level, to out
-void unparseBlock(FILE *out, AST *ast, int level)
+// Finish a public unparsing function's output,
+// flushing the buffer if it is the outermost one
+static void finish_output()
 {
-    AST_list cds = ast->data.program.cds;
-    AST_list vds = ast->data.program.vds;
-    AST *stmt = ast->data.program.stmt;
-    unparseConstDecls(out, cds, level);
-    unparseVarDecls(out, vds, level);
-    unparseStmt(out, stmt, level, false);
+    if (--unparse_nesting == 0) {
+	flush_output();
+    }
 }
 
-// Unparse the list of const-decls given by the AST cds to out
-// with the given nesting level
-// (note that if cds == NULL, then nothing is printed)
-void unparseConstDecls(FILE *out, AST_list cds, int level)
+// Put the len chars in str into the output for out
+static void emit(FILE *out, const char *str, size_t len)
 {
-    while (!ast_list_is_empty(cds)) {
-	unparseConstDecl(out, ast_list_first(cds), level);
-	cds = ast_list_rest(cds);
+    if (out != unparse_out) {
+	flush_output();
+	unparse_out = out;
+    }
+    if (unparse_buffer_len + len > UNPARSE_BUFFER_SIZE) {
+	flush_output();
+	if (len > UNPARSE_BUFFER_SIZE) {
+	    fwrite(str, 1, len, out);
+	    return;
+	}
     }
+    memcpy(unparse_buffer + unparse_buffer_len, str, len);
+    unparse_buffer_len += len;
 }
 
-// Unparse a single const-def given by the AST cd to out,
-// indented for the given nesting level
-static void unparseConstDecl(FILE *out, AST *cd, int level)
+// Put the string literal lit into the output for out
+#define EMIT_LITERAL(out, lit) emit((out), (lit), sizeof(lit) - 1)
+
+// Put the null-terminated string str into the output for out
+static void emit_string(FILE *out, const char *str)
 {
-    indent(out, level);
-    fprintf(out, "const ");
-    fprintf(out, "%s = ", cd->data.const_decl.name);
-    fprintf(out, "%d;\n", cd->data.const_decl.num_val);
+    emit(out, str, strlen(str));
 }
 
-// Unparse the list of vart-decls given by the AST vds to out
-// with the given nesting level
-// (note that if vds == NULL, then nothing is printed)
-void unparseVarDecls(FILE *out, AST_list vds, int level)
+// Put the decimal form of n into the output for out
+static void emit_int(FILE *out, int n)
 {
-    while (!ast_list_is_empty(vds)) {
-	unparseVarDecl(out, ast_list_first(vds), level);
-	vds = ast_list_rest(vds);
+    char digits[12]; // enough for a sign and the digits of any int
+    char *p = digits + sizeof(digits);
+    unsigned int u = (n < 0) ? 0u - (unsigned int) n : (unsigned int) n;
+    do {
+	*--p = (char) ('0' + u % 10);
+	u /= 10;
+    } while (u != 0);
+    if (n < 0) {
+	*--p = '-';
     }
+    emit(out, p, (size_t) (digits + sizeof(digits) - p));
 }
 
-// Unparse a single var-decl given by the AST vd to out,
-// indented for the given nesting level
-static void unparseVarDecl(FILE *out, AST *vd, int level)
+// Spaces for indentation, which are put into the output in pieces
+static const char spaces[] =
+    "                                                                ";
+
+// Put SPACES_PER_LEVEL * level spaces into the output for out
+static void indent(FILE *out, int level)
 {
-    indent(out, level);
-    fprintf(out, "var ");
-    fprintf(out, "%s;\n", vd->data.var_decl.name);
+    size_t num = SPACES_PER_LEVEL * (size_t) level;
+    while (num > 0) {
+	size_t len = (num < sizeof(spaces) - 1) ? num : sizeof(spaces) - 1;
+	emit(out, spaces, len);
+	num -= len;
+    }
 }
 
-// Print (to out) a semicolon, but only if addSemiToEnd is true,
-// and then print a newline.
-static void newlineAndOptionalSemi(FILE *out, bool addSemiToEnd)
+// Is the location loc1 before loc2 (in the same file)?
+static bool location_before(file_location loc1, file_location loc2)
 {
-    fprintf(out, "%s\n", (addSemiToEnd ? ";" : ""));
+    return loc1.line < loc2.line
+	|| (loc1.line == loc2.line && loc1.column < loc2.column);
 }
 
-// Unparse the statement given by the AST stmt to out,
-// indented for the given level,
-// adding a semicolon to the end if addSemiToENd is true.
-void unparseStmt(FILE *out, AST *stmt, int indentLevel, bool addSemiToEnd)
+// Put the comments that are not yet output and are before loc
+// into the output for out, each on its own line indented for level
+static void unparseCommentsBefore(FILE *out, file_location loc, int level)
+{
+    while (next_comment < num_unparse_comments
+	   && location_before(unparse_comments[next_comment].loc, loc)) {
+	indent(out, level);
+	emit_string(out, unparse_comments[next_comment].text);
+	EMIT_LITERAL(out, "\n");
+	next_comment++;
+    }
+}
+
+// Put the comments that are not yet output and are before the end
+// of the begin statement being closed into the output for out,
+// each on its own line indented for level
+static void unparseCommentsBeforeEnd(FILE *out, int level)
+{
+    // ends are only counted while comments are left to output,
+    // when statements are unparsed by a single thread
+    // (so threads unparsing in parallel do not share the count)
+    if (next_comment == num_unparse_comments) {
+	return;
+    }
+    while (next_comment < num_unparse_comments
+	   && unparse_comments[next_comment].ends_before <= ends_unparsed) {
+	indent(out, level);
+	emit_string(out, unparse_comments[next_comment].text);
+	EMIT_LITERAL(out, "\n");
+	next_comment++;
+    }
+    ends_unparsed++;
+}
+
+// Put the comments that are not yet output into the output for out,
+// each on its own line
+static void unparseRemainingComments(FILE *out)
+{
+    while (next_comment < num_unparse_comments) {
+	emit_string(out, unparse_comments[next_comment].text);
+	EMIT_LITERAL(out, "\n");
+	next_comment++;
+    }
+}
+
+// What kind of AST is expected where a walk of the unparser reaches one
+typedef enum {
+    block_place, decl_place, stmt_place, cond_place, expr_place
+} unparse_place;
+
+// A node being unparsed by a walk, and what is needed to finish it
+typedef struct {
+    AST *ast;
+    int level;               // the indentation level (for statements)
+    bool addSemiToEnd;       // does a semicolon go at its end?
+    bool parens;             // is it in parentheses (for expressions)?
+    unsigned int next_child; // the index of its next child to be unparsed
+} unparse_frame;
+
+// The state of a walk of the unparser over an AST:
+// the nodes being unparsed (those the walk is inside),
+// which are kept on a stack of their own, as the output between
+// and after a node's children depends on which child comes next
+typedef struct {
+    FILE *out;
+    unparse_place root_place; // what the root of the walk is
+    int root_level;
+    bool root_semi;
+    unparse_frame *frames;
+    unsigned int size, capacity;
+} unparse_walk;
+
+// Is the expression exp, which is the child (the right one, if is_right)
+// of a binary expression with the operator op, put in parentheses?
+static bool operand_needs_parens(AST *exp, bin_arith_op op, bool is_right)
+{
+    if (exp->type_tag != bin_expr_ast) {
+	return false;
+    }
+    if (!minimal_parens) {
+	return true;
+    }
+    int prec = arith_op_precedence(op);
+    int exp_prec = arith_op_precedence(exp->data.bin_expr.arith_op);
+    // operators are left associative, so a right operand needs them
+    // if its operator has the same precedence
+    return exp_prec < prec || (is_right && exp_prec == prec);
+}
+
+// Put into the output what comes before the ith child of the node
+// being unparsed in f, and set *child to how that child is unparsed
+// and return what kind of AST it should be
+static unparse_place enter_child(FILE *out, unparse_frame *f, unsigned int i,
+				 unparse_frame *child)
+{
+    AST *ast = f->ast;
+    child->level = f->level + 1;
+    child->addSemiToEnd = false;
+    // only binary expressions in binary expressions are put in parentheses
+    // minimally
+    child->parens = !minimal_parens;
+    switch (ast->type_tag) {
+    case program_ast:
+	child->level = f->level;
+	return (i < ast->data.program.num_cds + ast->data.program.num_vds)
+	    ? decl_place : stmt_place;
+    case begin_ast:
+	child->addSemiToEnd = i+1 < ast->data.begin_stmt.num_stmts;
+	return stmt_place;
+    case if_ast:
+	if (i == 0) {
+	    return cond_place;
+	}
+	if (i == 1) {
+	    EMIT_LITERAL(out, "\n");
+	    indent(out, f->level);
+	    EMIT_LITERAL(out, "then\n");
+	} else {
+	    indent(out, f->level);
+	    EMIT_LITERAL(out, "else\n");
+	    child->addSemiToEnd = f->addSemiToEnd;
+	}
+	return stmt_place;
+    case while_ast:
+	if (i == 0) {
+	    return cond_place;
+	}
+	EMIT_LITERAL(out, "\n");
+	indent(out, f->level);
+	EMIT_LITERAL(out, "do\n");
+	child->addSemiToEnd = f->addSemiToEnd;
+	return stmt_place;
+    case bin_cond_ast:
+	if (i == 1) {
+	    EMIT_LITERAL(out, " ");
+	    unparseRelOp(out, ast->data.bin_cond.relop);
+	    EMIT_LITERAL(out, " ");
+	}
+	return expr_place;
+    case bin_expr_ast:
+	if (i == 1) {
+	    EMIT_LITERAL(out, " ");
+	    unparseArithOp(out, ast->data.bin_expr.arith_op);
+	    EMIT_LITERAL(out, " ");
+	}
+	child->parens = operand_needs_parens(ast_child(ast, i),
+					     ast->data.bin_expr.arith_op, i == 1);
+	return expr_place;
+    default:
+	// assignments, write statements, and odd conditions
+	return expr_place;
+    }
+}
+
+// Put the start of the statement being unparsed in f into the output for out
+// and return whether its children should be unparsed by the walk
+static bool unparseStmtStart(FILE *out, unparse_frame *f)
 {
+    AST *stmt = f->ast;
+    int level = f->level;
+    unparseCommentsBefore(out, stmt->file_loc, level);
     switch (stmt->type_tag) {
     case assign_ast:
-	unparseAssignStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	emit_string(out, stmt->data.assign_stmt.name);
+	EMIT_LITERAL(out, " := ");
+	return true;
     case begin_ast:
-	unparseBeginStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	unparseBeginOpen(out, level);
+	// comments are put in the output in order, so they need a single thread
+	if (unparse_threads > 1 && !in_unparse_worker
+	    && stmt->data.begin_stmt.num_stmts >= PARALLEL_UNPARSE_MIN_STMTS
+	    && next_comment == num_unparse_comments) {
+	    unparseStmtListInParallel(out, stmt->data.begin_stmt.num_stmts,
+				      stmt->data.begin_stmt.stmts, level+1);
+	    return false;
+	}
+	return true;
     case if_ast:
-	unparseIfStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	EMIT_LITERAL(out, "if ");
+	return true;
     case while_ast:
-	unparseWhileStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	EMIT_LITERAL(out, "while ");
+	return true;
     case read_ast:
-	unparseReadStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	EMIT_LITERAL(out, "read ");
+	emit_string(out, stmt->data.read_stmt.name);
+	newlineAndOptionalSemi(out, f->addSemiToEnd);
+	return false;
     case write_ast:
-	unparseWriteStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	EMIT_LITERAL(out, "write ");
+	return true;
     case skip_ast:
-	unparseSkipStmt(out, indentLevel, addSemiToEnd);
-	break;
+	indent(out, level);
+	EMIT_LITERAL(out, "skip");
+	newlineAndOptionalSemi(out, f->addSemiToEnd);
+	return false;
     default:
 	bail_with_error("Call to unparseStmt with an AST that is not a statement!");
+	return false;
+    }
+}
+
+// Put the start of the node being unparsed in f, which should be the kind
+// of AST given by place, into the output for out
+// and return whether its children should be unparsed by the walk
+static bool unparseNodeStart(FILE *out, unparse_frame *f, unparse_place place)
+{
+    AST *ast = f->ast;
+    switch (place) {
+    case block_place:
+	return true;
+    case decl_place:
+	if (ast->type_tag == const_decl_ast) {
+	    unparseConstDecl(out, ast, f->level);
+	} else {
+	    unparseVarDecl(out, ast, f->level);
+	}
+	return false;
+    case stmt_place:
+	return unparseStmtStart(out, f);
+    case cond_place:
+	if (ast->type_tag == odd_cond_ast) {
+	    EMIT_LITERAL(out, "odd ");
+	} else if (ast->type_tag != bin_cond_ast) {
+	    bail_with_error("Unexpected type tag %d in unparseCondition!",
+			    ast->type_tag);
+	}
+	return true;
+    case expr_place:
+	switch (ast->type_tag) {
+	case bin_expr_ast:
+	    if (f->parens) {
+		EMIT_LITERAL(out, "(");
+	    }
+	    return true;
+	case ident_ast:
+	    unparseIdent(out, ast);
+	    return false;
+	case number_ast:
+	    unparseNumber(out, ast);
+	    return false;
+	default:
+	    bail_with_error("Unexpected type_tag %d in unparseExpr",
+			    ast->type_tag);
+	    return false;
+	}
+    }
+    return false;
+}
+
+// Start unparsing ast, the next node of the walk whose state is data
+// (a pre callback for ast_walk)
+static bool unparse_pre(AST *ast, void *data)
+{
+    unparse_walk *w = (unparse_walk *) data;
+    if (w->size == w->capacity) {
+	w->capacity = (w->capacity == 0) ? 64 : 2 * w->capacity;
+	w->frames = (unparse_frame *) alloc_list_realloc(w->frames,
+			    w->capacity * sizeof(unparse_frame));
+	if (w->frames == NULL) {
+	    bail_with_error("No space to unparse an AST!");
+	}
+    }
+    unparse_frame *f = &w->frames[w->size];
+    unparse_place place;
+    if (w->size == 0) {
+	place = w->root_place;
+	f->level = w->root_level;
+	f->addSemiToEnd = w->root_semi;
+	f->parens = !minimal_parens;
+    } else {
+	unparse_frame *parent = &w->frames[w->size - 1];
+	place = enter_child(w->out, parent, parent->next_child++, f);
+    }
+    f->ast = ast;
+    f->next_child = 0;
+    w->size++;
+    return unparseNodeStart(w->out, f, place);
+}
+
+// Finish unparsing ast, the node of the walk whose state is data
+// that was started last (a post callback for ast_walk)
+static void unparse_post(AST *ast, void *data)
+{
+    unparse_walk *w = (unparse_walk *) data;
+    unparse_frame *f = &w->frames[--w->size];
+    switch (ast->type_tag) {
+    case assign_ast:
+    case write_ast:
+	newlineAndOptionalSemi(w->out, f->addSemiToEnd);
+	break;
+    case begin_ast:
+	unparseBeginClose(w->out, f->level, f->addSemiToEnd);
+	break;
+    case bin_expr_ast:
+	if (f->parens) {
+	    EMIT_LITERAL(w->out, ")");
+	}
+	break;
+    default:
 	break;
     }
 }
 
-// Unparse the assignment statment given by stmt to out
-// with indentation level given by level,
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseAssignStmt(FILE *out, AST *stmt, int level,
-			      bool addSemiToEnd)
+// Unparse ast, which should be the kind of AST given by place, to out
+// with a walk (not recursion, so its nesting is only limited by memory),
+// indenting it for level and adding a semicolon to its end
+// if addSemiToEnd is true (if it is a statement)
+static void unparseWalk(FILE *out, AST *ast, unparse_place place, int level,
+			bool addSemiToEnd)
 {
-    indent(out, level);
-    fprintf(out, "%s := ", stmt->data.assign_stmt.name);
-    unparseExpr(out, stmt->data.assign_stmt.exp);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    unparse_walk w = { out, place, level, addSemiToEnd, NULL, 0, 0 };
+    ast_visitor v = { unparse_pre, unparse_post, &w };
+    start_output();
+    ast_walk(ast, &v, 1);
+    finish_output();
+    alloc_list_free(w.frames);
+}
+
+// Unparse the given program AST and then print a period and an newline
+void unparseProgram(FILE *out, AST *ast)
+{
+    start_output();
+    unparseBlock(out, ast, 0);
+    unparseProgramEnd(out);
+    finish_output();
 }
 
-// Unparse the sequential statment given by stmt to out
-// with indentation level given by level (indenting the body one more level)
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseBeginStmt(FILE *out, AST *stmt, int level,
-			     bool addSemiToEnd)
+// Unparse the end of a program (its final period and a newline) to out
+void unparseProgramEnd(FILE *out)
 {
-    indent(out, level);
-    fprintf(out, "begin\n");
-    AST *stmt1 = ast_list_first(stmt->data.begin_stmt.stmts);
-    AST_list rest = ast_list_rest(stmt->data.begin_stmt.stmts);
-    unparseStmtList(out, stmt1, rest, level+1, false);
-    indent(out, level);
-    fprintf(out, "end");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    start_output();
+    unparseRemainingComments(out);
+    EMIT_LITERAL(out, ".\n");
+    finish_output();
+}
+
+// Unparse the given block, indented by the given level, to out
+void unparseBlock(FILE *out, AST *ast, int level)
+{
+    unparseWalk(out, ast, block_place, level, false);
 }
 
-// Unparse the list of statments given by stmt to out
-// with indentation level given by level,
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseStmtList(FILE *out, AST *stmt1, AST_list rest,
-			   int level, bool addSemiToEnd)
+// Unparse the array of num_cds const-decls given by cds to out
+// with the given nesting level
+// (note that if num_cds == 0, then nothing is printed)
+void unparseConstDecls(FILE *out, unsigned int num_cds, AST **cds, int level)
 {
-    unparseStmt(out, stmt1, level, !ast_list_is_empty(rest));
-    while (!ast_list_is_empty(rest)) {
-	AST_list nxt = ast_list_rest(rest);
-	unparseStmt(out, rest, level, !ast_list_is_empty(nxt));
-	rest = nxt;
+    start_output();
+    for (unsigned int i = 0; i < num_cds; i++) {
+	unparseConstDecl(out, cds[i], level);
     }
+    finish_output();
 }
 
-// Unparse the if-statment given by stmt to out
-// with indentation level given by level (and each body indented one more),
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseIfStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// Unparse a single const-def given by the AST cd to out,
+// indented for the given nesting level
+static void unparseConstDecl(FILE *out, AST *cd, int level)
 {
+    unparseCommentsBefore(out, cd->file_loc, level);
     indent(out, level);
-    fprintf(out, "if ");
-    unparseCondition(out, stmt->data.if_stmt.cond);
-    fprintf(out, "\n");
-    indent(out, level);
-    fprintf(out, "then\n");
-    unparseStmt(out, stmt->data.if_stmt.thenstmt, level+1, false);
-    indent(out, level);
-    fprintf(out, "else\n");
-    unparseStmt(out, stmt->data.if_stmt.elsestmt, level+1, addSemiToEnd);
+    EMIT_LITERAL(out, "const ");
+    emit_string(out, cd->data.const_decl.name);
+    EMIT_LITERAL(out, " = ");
+    emit_int(out, cd->data.const_decl.num_val);
+    EMIT_LITERAL(out, ";\n");
 }
 
-// Unparse the while-statment given by stmt to out
-// with indentation level given by level (and the body indented one more),
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseWhileStmt(FILE *out, AST* stmt, int level, bool addSemiToEnd)
+// Unparse the array of num_vds var-decls given by vds to out
+// with the given nesting level
+// (note that if num_vds == 0, then nothing is printed)
+void unparseVarDecls(FILE *out, unsigned int num_vds, AST **vds, int level)
 {
-    indent(out, level);
-    fprintf(out, "while ");
-    unparseCondition(out, stmt->data.while_stmt.cond);
-    fprintf(out, "\n");
-    indent(out, level);
-    fprintf(out, "do\n");
-    unparseStmt(out, stmt->data.while_stmt.stmt, level+1, addSemiToEnd);
+    start_output();
+    for (unsigned int i = 0; i < num_vds; i++) {
+	unparseVarDecl(out, vds[i], level);
+    }
+    finish_output();
 }
 
-// Unparse the read statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseReadStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// Unparse a single var-decl given by the AST vd to out,
+// indented for the given nesting level
+static void unparseVarDecl(FILE *out, AST *vd, int level)
 {
+    unparseCommentsBefore(out, vd->file_loc, level);
     indent(out, level);
-    fprintf(out, "read %s", stmt->data.read_stmt.name);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    EMIT_LITERAL(out, "var ");
+    emit_string(out, vd->data.var_decl.name);
+    EMIT_LITERAL(out, ";\n");
+}
+
+// Print (to out) a semicolon, but only if addSemiToEnd is true,
+// and then print a newline.
+static void newlineAndOptionalSemi(FILE *out, bool addSemiToEnd)
+{
+    if (addSemiToEnd) {
+	EMIT_LITERAL(out, ";\n");
+    } else {
+	EMIT_LITERAL(out, "\n");
+    }
 }
 
-// Unparse the write statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseWriteStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// Unparse the statement given by the AST stmt to out,
+// indented for the given level,
+// adding a semicolon to the end if addSemiToENd is true.
+void unparseStmt(FILE *out, AST *stmt, int indentLevel, bool addSemiToEnd)
 {
+    unparseWalk(out, stmt, stmt_place, indentLevel, addSemiToEnd);
+}
+
+// Unparse the line that starts a begin statement to out,
+// indented for the given level
+// (its statements should then be unparsed indented one more level)
+void unparseBeginOpen(FILE *out, int level)
+{
+    start_output();
     indent(out, level);
-    fprintf(out, "write ");
-    unparseExpr(out, stmt->data.write_stmt.exp);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    EMIT_LITERAL(out, "begin\n");
+    finish_output();
 }
 
-// Unparse the write statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseSkipStmt(FILE *out, int level, bool addSemiToEnd)
+// Unparse the line that ends a begin statement to out,
+// indented for the given level (after any comments before it,
+// which are indented like the statements in the begin statement),
+// adding a semicolon to the end if addSemiToEnd is true.
+void unparseBeginClose(FILE *out, int level, bool addSemiToEnd)
 {
+    start_output();
+    unparseCommentsBeforeEnd(out, level+1);
     indent(out, level);
-    fprintf(out, "skip");
+    EMIT_LITERAL(out, "end");
     newlineAndOptionalSemi(out, addSemiToEnd);
+    finish_output();
 }
 
-// Unparse the condition given by cond to out
-void unparseCondition(FILE *out, AST *cond)
+// A contiguous part of a statement list that one thread unparses
+// into memory
+typedef struct {
+    AST **stmts; // the whole list
+    unsigned int num_stmts; // the length of the whole list
+    unsigned int start; // index of the first statement in the chunk
+    unsigned int end; // index just past the last statement in the chunk
+    int level;
+    char *text; // the chunk's output, once unparsed (malloc'd)
+    size_t len; // the length of text
+} unparse_chunk;
+
+// Unparse the statements in the chunk given by arg into its text
+static void *unparse_chunk_worker(void *arg)
 {
-    switch (cond->type_tag) {
-    case odd_cond_ast:
-	unparseOddCond(out, cond);
-	break;
-    case bin_cond_ast:
-	unparseBinRelCond(out, cond);
-	break;
-    default:
-	bail_with_error("Unexpected type tag %d in unparseCondition!",
-			cond->type_tag);
-	break;
+    unparse_chunk *c = (unparse_chunk *) arg;
+    FILE *mem = open_memstream(&c->text, &c->len);
+    if (mem == NULL) {
+	bail_with_error("Unable to create a buffer for unparsing!");
+    }
+    in_unparse_worker = true;
+    start_output();
+    for (unsigned int i = c->start; i < c->end; i++) {
+	unparseStmt(mem, c->stmts[i], c->level, i+1 < c->num_stmts);
     }
+    finish_output();
+    fclose(mem);
+    return NULL;
 }
 
-// Unparse the odd condition given by cond to out
-static void unparseOddCond(FILE *out, AST *cond)
+// Unparse the array of num_stmts statments given by stmts to out,
+// with indentation level given by level, separating them with semicolons,
+// but splitting them into unparse_threads chunks
+// that are unparsed into memory by separate threads,
+// and then putting the chunks into the output in order
+// (so the output is the same as if it were done serially).
+static void unparseStmtListInParallel(FILE *out, unsigned int num_stmts,
+				      AST **stmts, int level)
 {
-    fprintf(out, "odd ");
-    unparseExpr(out, cond->data.odd_cond.exp);
+    unsigned int n = unparse_threads;
+    unparse_chunk *chunks = (unparse_chunk *) malloc(n * sizeof(unparse_chunk));
+    pthread_t *threads = (pthread_t *) malloc(n * sizeof(pthread_t));
+    if (chunks == NULL || threads == NULL) {
+	bail_with_error("No space to unparse in parallel!");
+    }
+
+    for (unsigned int t = 0; t < n; t++) {
+	chunks[t].stmts = stmts;
+	chunks[t].num_stmts = num_stmts;
+	chunks[t].start = (unsigned int) ((unsigned long long) num_stmts * t / n);
+	chunks[t].end = (unsigned int) ((unsigned long long) num_stmts * (t+1) / n);
+	chunks[t].level = level;
+	chunks[t].text = NULL;
+	chunks[t].len = 0;
+	if (pthread_create(&threads[t], NULL, unparse_chunk_worker,
+			   &chunks[t]) != 0) {
+	    bail_with_error("Unable to start a thread for unparsing!");
+	}
+    }
+
+    for (unsigned int t = 0; t < n; t++) {
+	pthread_join(threads[t], NULL);
+	emit(out, chunks[t].text, chunks[t].len);
+	free(chunks[t].text);
+    }
+
+    free(chunks);
+    free(threads);
 }
 
-// Unparse the binary relation condition given by cond to out
-static void unparseBinRelCond(FILE *out, AST *cond)
+// Unparse the condition given by cond to out
+void unparseCondition(FILE *out, AST *cond)
 {
-    unparseExpr(out, cond->data.bin_cond.leftexp);
-    fprintf(out, " ");
-    unparseRelOp(out, cond->data.bin_cond.relop);
-    fprintf(out, " ");
-    unparseExpr(out, cond->data.bin_cond.rightexp);
+    unparseWalk(out, cond, cond_place, 0, false);
 }
 
 // Unparse the given relational operator, relop, to out
 void unparseRelOp(FILE *out, rel_op relop)
 {
+    start_output();
     switch (relop) {
     case eqop:
-	fprintf(out, "=");
+	EMIT_LITERAL(out, "=");
 	break;
     case neqop:
-	fprintf(out, "<>");
+	EMIT_LITERAL(out, "<>");
 	break;
     case ltop:
-	fprintf(out, "<");
+	EMIT_LITERAL(out, "<");
 	break;
     case leqop:
-	fprintf(out, "<=");
+	EMIT_LITERAL(out, "<=");
 	break;
     case gtop:
-	fprintf(out, ">");
+	EMIT_LITERAL(out, ">");
 	break;
     case geqop:
-	fprintf(out, ">=");
+	EMIT_LITERAL(out, ">=");
 	break;
     default:
 	bail_with_error("Unknown rel_op %d", relop);
 	break;
     }
+    finish_output();
 }
 
 // Unparse the expression given by the AST exp to out
 // adding parentheses to indicate the nesting relationships
+// (around every binary expression, or, if minimal_parens is set,
+// only where they are needed for it to be parsed the same way again)
 void unparseExpr(FILE *out, AST *exp)
 {
-    switch (exp->type_tag) {
-    case bin_expr_ast:
-	unparseBinExpr(out, exp);
-	break;
-    case ident_ast:
-	unparseIdent(out, exp);
-	break;
-    case number_ast:
-	unparseNumber(out, exp);
-	break;
-    default:
-	bail_with_error("Unexpected type_tag %d in unparseExpr", exp->type_tag);
-	break;
-    }
+    unparseWalk(out, exp, expr_place, 0, false);
 }
 
-// Unparse the expression given by the AST exp to out
-// adding parentheses (whether needed or not)
-static void unparseBinExpr(FILE *out, AST *exp)
+// Return the precedence of op (higher binds tighter)
+static int arith_op_precedence(bin_arith_op op)
 {
-    fprintf(out, "(");
-    unparseExpr(out, exp->data.bin_expr.leftexp);
-    fprintf(out, " ");
-    unparseArithOp(out, exp->data.bin_expr.arith_op);
-    fprintf(out, " ");
-    unparseExpr(out, exp->data.bin_expr.rightexp);
-    fprintf(out, ")");
+    return (op == multop || op == divop) ? 2 : 1;
 }
 
 // Unparse the given bin_arith_opo to out
 void unparseArithOp(FILE *out, bin_arith_op op)
 {
+    start_output();
     switch (op) {
     case addop:
-	fprintf(out, "+");
+	EMIT_LITERAL(out, "+");
 	break;
     case subop:
-	fprintf(out, "-");
+	EMIT_LITERAL(out, "-");
 	break;
     case multop:
-	fprintf(out, "*");
+	EMIT_LITERAL(out, "*");
 	break;
     case divop:
-	fprintf(out, "/");
+	EMIT_LITERAL(out, "/");
 	break;
     default:
 	bail_with_error("Unexpected bin_arith_op %d in unparseArithOp", op);
 	break;
     }
+    finish_output();
 }
 
 // Unparse the given identifer reference (use) to out
 void unparseIdent(FILE *out, AST *id)
 {
-    fprintf(out, "%s", id->data.ident.name);
+    start_output();
+    emit_string(out, id->data.ident.name);
+    finish_output();
 }
 
 // Unparse the given number to out in decimal format
 void unparseNumber(FILE *out, AST *num)
 {
-    fprintf(out, "%d", num->data.number.value);
+    start_output();
+    emit_int(out, num->data.number.value);
+    finish_output();
 }
@@ -3,22 +3,52 @@
 #define _UNPARSER_H
 #include <stdio.h>
 #include "ast.h"
+#include "lexer.h"
+
+// The unparser collects its output in a buffer and writes it to out
+// in large chunks; by the time any of these functions returns,
+// all of its output has been written to out (though out itself
+// may still buffer it, as usual for a FILE).
+
+// Set the number of threads used to unparse long statement lists
+// (the default, 1, means everything is unparsed by the calling thread).
+// The output is the same no matter how many threads are used.
+extern void unparser_set_threads(unsigned int num_threads);
+
+// Set whether expressions are printed with only the parentheses
+// needed for them to be parsed the same way again
+// (the default, false, puts parentheses around every binary expression)
+extern void unparser_set_minimal_parens(bool on);
+
+// Set the comments (an array of num_comments comments, in source order)
+// to put into the output: each comment is printed on a line of its own,
+// just before the first declaration, statement, or end of a begin statement
+// that follows it in the source (or before the final period, if none does).
+// The array must not be changed until the unparsing is done;
+// use unparser_set_comments(0, NULL) to stop printing comments.
+extern void unparser_set_comments(unsigned int num_comments,
+				  lexer_comment *comments);
 
 // Unparse the given program AST and then print a period and an newline
 extern void unparseProgram(FILE *out, AST *ast);
 
+// Unparse the end of a program (its final period and a newline) to out
+extern void unparseProgramEnd(FILE *out);
+
 // Unparse the given block, indented by the given level, to out
 extern void unparseBlock(FILE *out, AST *ast, int indentLevel);
 
-// Unparse the list of const-decls given by the AST cds to out
+// Unparse the array of num_cds const-decls given by cds to out
 // with the given nesting level
-// (note that if cds == NULL, then nothing is printed)
-extern void unparseConstDecls(FILE *out, AST *cds, int level);
+// (note that if num_cds == 0, then nothing is printed)
+extern void unparseConstDecls(FILE *out, unsigned int num_cds, AST **cds,
+			      int level);
 
-// Unparse the list of vart-decls given by the AST vds to out
+// Unparse the array of num_vds var-decls given by vds to out
 // with the given nesting level
-// (note that if vds == NULL, then nothing is printed)
-extern void unparseVarDecls(FILE *out, AST *vds, int level);
+// (note that if num_vds == 0, then nothing is printed)
+extern void unparseVarDecls(FILE *out, unsigned int num_vds, AST **vds,
+			    int level);
 
 // Unparse the statement given by the AST stmt to out,
 // indented for the given level,
@@ -26,6 +56,16 @@ extern void unparseVarDecls(FILE *out, AST *vds, int level);
 extern void unparseStmt(FILE *out, AST *stmt, int indentLevel,
 			bool addSemiToEnd);
 
+// Unparse the line that starts a begin statement to out,
+// indented for the given level
+// (its statements should then be unparsed indented one more level)
+extern void unparseBeginOpen(FILE *out, int level);
+
+// Unparse the line that ends a begin statement to out,
+// indented for the given level,
+// adding a semicolon to the end if addSemiToEnd is true.
+extern void unparseBeginClose(FILE *out, int level, bool addSemiToEnd);
+
 // Unparse the condition given by cond to out
 extern void unparseCondition(FILE *out, AST *cond);
 
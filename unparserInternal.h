@@ -6,27 +6,11 @@ static void unparseConstDecl(FILE *out, AST *cd, int level);
 
 static void unparseVarDecl(FILE *out, AST *vd, int level);
 
-static void unparseAssignStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void newlineAndOptionalSemi(FILE *out, bool addSemiToEnd);
 
-static void unparseBeginStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void unparseStmtListInParallel(FILE *out, unsigned int num_stmts,
+				      AST **stmts, int level);
 
-static void unparseStmtList(FILE *out, AST *stmt1, AST *rest,
-			   int level, bool addSemiToEnd);
-
-static void unparseIfStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
-
-static void unparseWhileStmt(FILE *out, AST* stmt, int level, bool addSemiToEnd);
-
-static void unparseReadStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
-
-static void unparseWriteStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
-
-static void unparseSkipStmt(FILE *out, int level, bool addSemiToEnd);
-
-static void unparseOddCond(FILE *out, AST *cond);
-
-static void unparseBinRelCond(FILE *out, AST *cond);
-
-static void unparseBinExpr(FILE *out, AST *exp);
+static int arith_op_precedence(bin_arith_op op);
 
 #endif
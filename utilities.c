@@ -42,25 +42,53 @@ static void vdebug_print(const char *fmt, va_list args)
 }
 #endif
 
-static void vbail_with_error(const char* fmt, va_list args);
+// The error catcher that errors are reported to (see set_error_catcher),
+// or NULL if they are printed on stderr
+static error_catcher *catcher = NULL;
 
-// Format a string error message and print it followed by a newline on stderr
-// using perror (for an OS error, if the errno is not 0)
-// then exit with a failure code, so a call to this does not return.
-void bail_with_error(const char *fmt, ...)
+// Whether general_error defers its errors (see defer_semantic_errors),
+// and the first error it deferred, if have_deferred
+static bool deferring = false;
+static bool have_deferred = false;
+static file_location deferred_loc;
+static char deferred_message[ERROR_MESSAGE_SIZE];
+
+// Make the error functions record their errors in the given catcher
+// and longjmp to its env, or, if catcher is NULL,
+// make them print their errors on stderr and exit.
+void set_error_catcher(error_catcher *c)
 {
-    fflush(stdout); // flush so output comes after what has happened already
-    va_list(args);
-    va_start(args, fmt);
-    vbail_with_error(fmt, args);
+    catcher = c;
 }
 
-// The variadic version of bail_with_error
-static void vbail_with_error(const char* fmt, va_list args)
+// Report the error of the given kind, at loc (unless loc.filename is NULL),
+// whose message is formatted from fmt and args.
+// If there is an error catcher, record the error in it and jump to it,
+// otherwise print the message (and, for an OS error, if errno is not 0,
+// the reason for it) followed by a newline on stderr
+// and exit with a failure code, so a call to this does not return.
+static void vreport_error(error_kind kind, file_location loc,
+			  const char *fmt, va_list args)
 {
     extern int errno;
-    char buff[2048];
-    vsprintf(buff, fmt, args);
+    char buff[ERROR_MESSAGE_SIZE];
+    vsnprintf(buff, sizeof(buff), fmt, args);
+    if (catcher != NULL) {
+	catcher->kind = kind;
+	catcher->loc = loc;
+	size_t len = strlen(buff);
+	memcpy(catcher->message, buff, len + 1);
+	if (errno != 0) {
+	    snprintf(catcher->message + len, sizeof(catcher->message) - len,
+		     ": %s", strerror(errno));
+	}
+	longjmp(catcher->env, 1);
+    }
+    fflush(stdout); // flush so output comes after what has happened already
+    if (loc.filename != NULL) {
+	fprintf(stderr, "%s: line %d, column %d: ",
+		loc.filename, loc.line, loc.column);
+    }
     if (errno != 0) {
 	perror(buff);
     } else {
@@ -70,14 +98,36 @@ static void vbail_with_error(const char* fmt, va_list args)
     exit(EXIT_FAILURE);
 }
 
+// Report the error as by vreport_error, but with the message's arguments
+// given directly
+static void report_error(error_kind kind, file_location loc,
+			 const char *fmt, ...)
+{
+    va_list(args);
+    va_start(args, fmt);
+    vreport_error(kind, loc, fmt, args);
+}
+
+// A location for errors that have none
+static const file_location no_location = { NULL, 0, 0 };
+
+// Format a string error message and print it followed by a newline on stderr
+// using perror (for an OS error, if the errno is not 0)
+// then exit with a failure code, so a call to this does not return.
+void bail_with_error(const char *fmt, ...)
+{
+    va_list(args);
+    va_start(args, fmt);
+    vreport_error(fatal_err, no_location, fmt, args);
+}
+
 void lexical_error(const char *filename, unsigned int line,
 			  unsigned int column, const char *fmt, ...)
 {
-    fflush(stdout); // flush so output comes after what has happened already
-    fprintf(stderr, "%s: line %d, column %d: ", filename, line, column);
+    file_location loc = { filename, line, column };
     va_list(args);
     va_start(args, fmt);
-    vbail_with_error(fmt, args);
+    vreport_error(lexical_err, loc, fmt, args);
 }
 
 const char *token2string(token t)
@@ -105,31 +155,30 @@ void parse_error_unexpected(token_type *expected,
 			    unsigned int num_expected,
 			    token saw)
 {
-    fflush(stdout); // flush so output comes after what has happened already
-    // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: syntax error, ",
-	    saw.filename, saw.line, saw.column);
-
-    // print what was expected and what was seen, then bail out!
+    // say what was expected and what was seen, then bail out!
+    char buff[ERROR_MESSAGE_SIZE];
+    size_t len = 0;
     if (num_expected == 1) {
-	bail_with_error("expecting a %s token, but saw a %s token (\"%s\")",
-			ttyp2str(expected[0]), ttyp2str(saw.typ),
-			(saw.text != NULL ? saw.text : ""));
+	snprintf(buff, sizeof(buff), "expecting a %s token",
+		 ttyp2str(expected[0]));
     } else {
 	// num_expected > 1
-	fprintf(stderr, "Expecting one of: ");
-	for (int i = 0; i < num_expected; i++) {
+	len += snprintf(buff, sizeof(buff), "Expecting one of: ");
+	for (int i = 0; i < num_expected && len < sizeof(buff); i++) {
 	    if (0 < i && i < num_expected-1) {
-		fprintf(stderr, ", ");
+		len += snprintf(buff + len, sizeof(buff) - len, ", ");
 	    } else if (i == num_expected-1) {
-		fprintf(stderr, " or ");
+		len += snprintf(buff + len, sizeof(buff) - len, " or ");
+	    }
+	    if (len < sizeof(buff)) {
+		len += snprintf(buff + len, sizeof(buff) - len, "%s",
+				ttyp2str(expected[i]));
 	    }
-	    fprintf(stderr, "%s", ttyp2str(expected[i]));
 	}
-	bail_with_error(", but saw a %s token (\"%s\")",
-			ttyp2str(saw.typ),
-			(saw.text != NULL ? saw.text : ""));
     }
+    report_error(syntax_err, token2file_loc(saw),
+		 "syntax error, %s, but saw a %s token (\"%s\")",
+		 buff, ttyp2str(saw.typ), (saw.text != NULL ? saw.text : ""));
 }
 
 // Print a parsing error message on stderr from the parser
@@ -138,14 +187,9 @@ void parse_error_unexpected(token_type *expected,
 // Then exit with a failure code, so this function does not return.
 void parse_error_general(token t, const char *fmt, ...)
 {
-    fflush(stdout); // flush so output comes after what has happened already
-    // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: ",
-	    t.filename, t.line, t.column);
-
     va_list(args);
     va_start(args, fmt);
-    vbail_with_error(fmt, args);
+    vreport_error(syntax_err, token2file_loc(t), fmt, args);
 }
 
 // Print a compiler error message on stderr
@@ -154,12 +198,34 @@ void parse_error_general(token t, const char *fmt, ...)
 // Then exit with a failure code, so this function does not return.
 void general_error(file_location floc, const char *fmt, ...)
 {
-    fflush(stdout); // flush so output comes after what has happened already
-    // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: ",
-	    floc.filename, floc.line, floc.column);
-
     va_list(args);
     va_start(args, fmt);
-    vbail_with_error(fmt, args);
+    if (deferring) {
+	if (!have_deferred) {
+	    vsnprintf(deferred_message, sizeof(deferred_message), fmt, args);
+	    deferred_loc = floc;
+	    have_deferred = true;
+	}
+	va_end(args);
+	return;
+    }
+    vreport_error(semantic_err, floc, fmt, args);
+}
+
+// Set whether general_error defers its errors (see utilities.h)
+void defer_semantic_errors(bool on)
+{
+    deferring = on;
+    if (on) {
+	have_deferred = false;
+    }
+}
+
+// Report the error that general_error deferred, if there is one
+void report_deferred_error()
+{
+    if (have_deferred) {
+	have_deferred = false;
+	report_error(semantic_err, deferred_loc, "%s", deferred_message);
+    }
 }
@@ -3,9 +3,39 @@
 #define _UTILITIES_H
 #include <stdbool.h>
 #include <assert.h>
+#include <setjmp.h>
 #include "token.h"
 #include "file_location.h"
 
+// Maximum length of a message kept by an error catcher (with its '\0')
+#define ERROR_MESSAGE_SIZE 2048
+
+// The kinds of errors reported by the error functions below
+typedef enum {
+    fatal_err,      // from bail_with_error (e.g., an I/O error or no space)
+    lexical_err,    // from lexical_error
+    syntax_err,     // from parse_error_unexpected or parse_error_general
+    semantic_err    // from general_error (e.g., an undeclared identifier)
+} error_kind;
+
+// An error catcher lets a program that uses the compiler as a library
+// handle errors itself (see set_error_catcher):
+// the error functions below record the error in it
+// and then longjmp to its env, instead of printing it and exiting.
+typedef struct {
+    jmp_buf env;
+    error_kind kind;
+    // where the error is (loc.filename is NULL for a fatal_err)
+    file_location loc;
+    // the message, without the location or a newline
+    char message[ERROR_MESSAGE_SIZE];
+} error_catcher;
+
+// Make the error functions below record their errors in catcher
+// and longjmp to catcher->env, or, if catcher is NULL,
+// make them print their errors on stderr and exit (as they do by default).
+extern void set_error_catcher(error_catcher *catcher);
+
 // If NDEBUG is defined, do nothing, otherwise (when debugging)
 // flush stderr and stdout, then print the message given on stderr,
 // using printf formatting from the format string fmt.
@@ -44,7 +74,20 @@ extern void parse_error_general(token t, const char *fmt, ...);
 // Print a compiler error message on stderr
 // starting with the filename, a colon, the line number, a comma
 // the column number, a colon, and then the message.
-// Then exit with a failure code, so this function does not return.
+// Then exit with a failure code, so this function does not return
+// (unless semantic errors are being deferred, see defer_semantic_errors).
 extern void general_error(file_location floc, const char *fmt, ...);
 
+// Set whether general_error defers its errors: when on, it only records
+// the first error it is called with and returns, so that the error can be
+// reported later (by report_deferred_error), after any lexical or syntax
+// errors found before then (as when checking a program while parsing it,
+// which must report the same error as checking it after parsing it).
+// Turning this on forgets any error that was deferred already.
+extern void defer_semantic_errors(bool on);
+
+// If general_error deferred an error, report it as general_error would
+// have (so this does not return); otherwise do nothing
+extern void report_deferred_error();
+
 #endif
@@ -0,0 +1,221 @@
+// watch directories for PL/0 files being written (see watcher.h)
+// for strdup
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "watcher.h"
+#include "utilities.h"
+
+// The suffix of the names of the files that are acted on
+#define WATCH_SUFFIX ".pl0"
+// The events watched for in each directory
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+// The inotify instance that watches the directories
+static int inotify_fd = -1;
+// The names of the watched directories, indexed by their watch descriptors
+// (NULL for those that are not in use)
+static char **watched = NULL;
+static int num_watched = 0;
+
+// Return the name of the file named name in the directory dir (malloc'd)
+static char *join_path(const char *dir, const char *name)
+{
+    size_t dirlen = strlen(dir);
+    size_t namelen = strlen(name);
+    char *path = malloc(dirlen + 1 + namelen + 1);
+    if (path == NULL) {
+	bail_with_error("No space to watch %s", dir);
+    }
+    memcpy(path, dir, dirlen);
+    path[dirlen] = '/';
+    memcpy(path + dirlen + 1, name, namelen + 1);
+    return path;
+}
+
+// Watch the directory dir and all the directories in it;
+// if dir cannot be watched, report an error if required,
+// and otherwise just skip it
+static void watch_tree(const char *dir, bool required)
+{
+    int wd = inotify_add_watch(inotify_fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+	if (required) {
+	    bail_with_error("Cannot watch %s", dir);
+	}
+	errno = 0;
+	return;
+    }
+    if (wd >= num_watched) {
+	int new_num = (wd < 32) ? 64 : 2 * wd;
+	char **grown = realloc(watched, new_num * sizeof(char *));
+	if (grown == NULL) {
+	    bail_with_error("No space to watch %s", dir);
+	}
+	for (int i = num_watched; i < new_num; i++) {
+	    grown[i] = NULL;
+	}
+	watched = grown;
+	num_watched = new_num;
+    }
+    free(watched[wd]);
+    watched[wd] = strdup(dir);
+    if (watched[wd] == NULL) {
+	bail_with_error("No space to watch %s", dir);
+    }
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+	errno = 0;
+	return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+	if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+	    continue;
+	}
+	char *path = join_path(dir, de->d_name);
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+	    watch_tree(path, false);
+	}
+	free(path);
+    }
+    closedir(d);
+    errno = 0;
+}
+
+// Does name end in WATCH_SUFFIX (and have something before it)?
+static bool has_watched_suffix(const char *name)
+{
+    size_t len = strlen(name);
+    size_t suffix_len = strlen(WATCH_SUFFIX);
+    return len > suffix_len
+	&& strcmp(name + len - suffix_len, WATCH_SUFFIX) == 0;
+}
+
+// Return all of the file named fname in a freshly allocated buffer,
+// setting *len to the number of chars read,
+// or return NULL if it cannot be read (e.g., if it was removed already)
+static char *read_whole_file(const char *fname, size_t *len)
+{
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+	errno = 0;
+	return NULL;
+    }
+    size_t cap = BUFSIZ;
+    size_t n = 0;
+    char *buf = malloc(cap);
+    size_t got;
+    while (buf != NULL && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+	n += got;
+	if (n == cap) {
+	    cap *= 2;
+	    char *grown = realloc(buf, cap);
+	    if (grown == NULL) {
+		free(buf);
+	    }
+	    buf = grown;
+	}
+    }
+    if (buf != NULL && ferror(f)) {
+	free(buf);
+	buf = NULL;
+    }
+    fclose(f);
+    errno = 0;
+    *len = n;
+    return buf;
+}
+
+// Read the file named fname and call act on it (unless it cannot be read)
+static void act_on_file(const char *fname, watch_action act)
+{
+    size_t len;
+    char *text = read_whole_file(fname, &len);
+    if (text != NULL) {
+	act(fname, text, len);
+	free(text);
+    }
+}
+
+// Watch the directory dir and all the directories in it,
+// and call act on each .pl0 file that is written in them
+void watch_directory(const char *dir, watch_action act)
+{
+    inotify_fd = inotify_init();
+    if (inotify_fd < 0) {
+	bail_with_error("Cannot watch %s", dir);
+    }
+    watch_tree(dir, true);
+
+    // a buffer for events (which have a name of up to NAME_MAX chars)
+    union {
+	struct inotify_event event;
+	char bytes[BUFSIZ];
+    } buf;
+    for (;;) {
+	ssize_t got = read(inotify_fd, buf.bytes, sizeof(buf.bytes));
+	if (got < 0) {
+	    if (errno == EINTR) {
+		errno = 0;
+		continue;
+	    }
+	    bail_with_error("Cannot watch %s", dir);
+	}
+	// each file written (perhaps more than once) in this batch of events,
+	// so that each is only acted on once, in the order first written
+	char **changed = NULL;
+	size_t num_changed = 0;
+	for (char *p = buf.bytes; p < buf.bytes + got; ) {
+	    struct inotify_event *ev = (struct inotify_event *) p;
+	    p += sizeof(struct inotify_event) + ev->len;
+	    if (ev->wd < 0 || ev->wd >= num_watched || watched[ev->wd] == NULL) {
+		continue;
+	    }
+	    if (ev->mask & IN_IGNORED) {
+		// the directory was removed
+		free(watched[ev->wd]);
+		watched[ev->wd] = NULL;
+		continue;
+	    }
+	    if (ev->len == 0) {
+		continue;
+	    }
+	    char *path = join_path(watched[ev->wd], ev->name);
+	    if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+		watch_tree(path, false);
+	    } else if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		       && !(ev->mask & IN_ISDIR) && has_watched_suffix(ev->name)) {
+		bool seen = false;
+		for (size_t i = 0; i < num_changed && !seen; i++) {
+		    seen = strcmp(changed[i], path) == 0;
+		}
+		if (!seen) {
+		    char **grown
+			= realloc(changed, (num_changed + 1) * sizeof(char *));
+		    if (grown == NULL) {
+			bail_with_error("No space to watch %s", dir);
+		    }
+		    changed = grown;
+		    changed[num_changed++] = path;
+		    continue;
+		}
+	    }
+	    free(path);
+	}
+	for (size_t i = 0; i < num_changed; i++) {
+	    act_on_file(changed[i], act);
+	    free(changed[i]);
+	}
+	free(changed);
+    }
+}
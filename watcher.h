@@ -0,0 +1,17 @@
+#ifndef _WATCHER_H
+#define _WATCHER_H
+#include <stddef.h>
+
+// The function called on each PL/0 file that is written:
+// fname is its name and text holds its len chars
+typedef void (*watch_action)(const char *fname, const char *text, size_t len);
+
+// Requires: dir != NULL and act != NULL
+// Watch the directory dir and all the directories in it (using inotify),
+// and each time a file whose name ends in .pl0 is written
+// (or moved there, as editors do when saving), read it and call act on it.
+// This does not return unless the directory cannot be watched,
+// in which case it reports an error.
+extern void watch_directory(const char *dir, watch_action act);
+
+#endif